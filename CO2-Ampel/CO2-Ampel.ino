@@ -28,9 +28,17 @@
  *******************************************************************************/
 
 #include "config.h"
+#include "i2cbus.h"
 #include "led.h"
 #include "rtc.h"
+#include "scheduler.h"
 #include "sensors.h"
+#include "snapshot.h"
+#include "resume.h"
+#include "battery.h"
+#include "exposure.h"
+#include "baseline.h"
+#include "selfheat.h"
 #include "webserver.h"
 #include "wifi.h"
 #include "logging.h"
@@ -48,7 +56,10 @@ void setup() {
   Serial.printf("%s (v%d)\n", "CO2-Ampel-BME280-LoRaWAN-MQTT-RESTful", FIRMWARE_VERSION);
 
   bootMessage();
+  if (runmode == WAKEUP)
+    continueDeepSleep();
   led_init();
+  resume_load();  // fast resume after deep sleep
   mountFS();
 
   sprintf(buf, "%s,v%d", runmodes[runmode], FIRMWARE_VERSION);
@@ -56,19 +67,22 @@ void setup() {
   
   pinMode(A0, INPUT);
   checkLowBat();
+  bootPhase("init");
    
-  // initialize I2C bus and check for (right) number of devices
-  if (i2c_init() != 4) { // SCD30, BME280, DS3231, EEPROM
+  // initialize I2C bus and probe for devices, only a missing
+  // SCD30 is fatal, others will just disable some features
+  if (!i2c_init()) {
     Serial.println(F("I2C bus error...system halted!"));
     while (1) {
       logMsg("i2c error");
       blink_leds(ALL_LEDS, RED, 500, 1, false);
       delay(2000);
     }
-  } else {
+  } else if (!resumed) {
     blink_leds(HALF_RING, WHITE, 500, 2, false);
-    delay(1000);
   }
+  rtc_init();
+  bootPhase("i2c");
 
   // reset button will clear system settings
   if (runmode == RESET) {
@@ -76,7 +90,7 @@ void setup() {
     resetGeneralSettings();
     resetMQTTSettings();
     resetWifiSettings();
-  } else {
+  } else if (!resumed) {
     // load general settings from DS3231 EEPROM (24C32)
     loadGeneralSettings();
   }
@@ -85,6 +99,18 @@ void setup() {
   // in NOOP mode only webserver and MQTT are enabled (optional)
   checkNOOPTime(settings.beginSleep, settings.endSleep);
 
+  // always start an AP and fire up local webserver with (optional) timeout
+  // to allow access to system settings or we'd be locked out until NOOP
+  // time has finished...
+  loadWifiSettings();
+  wifi_hotspot(false);
+  webserver_start((co2status == NOOP && runmode != RESET) ? WEBSERVER_TIMEOUT_NOOP : wifiSettings.webserverTimeout);
+
+  // connect to local WiFi in background while LoRaWAN and sensors are set up
+  if (wifiSettings.enableWLANUplink)
+    wifi_connect();
+  bootPhase("wifi ap");
+
   // recommended: https://github.com/hallard/WeMos-Lora
 #ifdef HAS_LORAWAN_SHIELD
   if (runmode == RESET) {
@@ -99,25 +125,41 @@ void setup() {
     Serial.println(F("LoRaWAN disabled."));
     logMsg("lorawan disabled");
   }
+  bootPhase("lorawan");
 #endif
 
-  // always start an AP and fire up local webserver with (optional) timeout
-  // to allow access to system settings or we'd be locked out until NOOP
-  // time has finished...
-  loadWifiSettings();
-  wifi_hotspot(false);
-  webserver_start((co2status == NOOP && runmode != RESET) ? WEBSERVER_TIMEOUT_NOOP : wifiSettings.webserverTimeout);
+  // sensors are disabled in NOOP mode, warm up continues in loop()
+  if (co2status != NOOP) {
+    sensors_init();
+    bootPhase("sensors");
+  }
 
-  // try to connect to local WiFi to update RTC and send push MQTT messages
+  // wait for WiFi uplink to update RTC and send push MQTT messages
   if (wifiSettings.enableWLANUplink) {
-    wifi_uplink(true);
-    startNTPSync();
+    wifi_connect();  // no-op if already associating
+    wifi_wait(WIFI_STA_CONNECT_TIMEOUT*2);  // keeps trying in background
+    bootPhase("wifi sta");
+    if (wifi_uplink(false)) {
+      startNTPSync();
+      bootPhase("ntp");
+    }
   }
   Serial.printf("Local time (RTC): %s, %s\n", getDateString(), getTimeString(true));
+
+  // requires valid time to pick recent readings from log
+  battery_load();
+  bootPhase("battery");
+  loadExposure();
+#ifdef SCD30_AUTO_BASELINE
+  loadBaseline();
+#endif
+  loadSelfheat();
   
   loadMQTTSettings();
+  snapshot_update();
   if (wifiSettings.enableWLANUplink && mqttSettings.enabled) {
     mqtt_send(500); // send initial alive message after system startup
+    bootPhase("mqtt");
   } else if (!mqttSettings.enabled) {
     Serial.println(F("MQTT disabled."));
     logMsg("mqtt disabled");
@@ -127,11 +169,12 @@ void setup() {
   }
 
   if (co2status != NOOP) {
-    sensors_init();
-    rotateLogs();
+    if (!resumed)
+      rotateLogs();
+    bootSummary();
     Serial.println(F("Setup completed.\n"));
   } else {
-    // sensors are disabled in NOOP mode
+    bootSummary();
     Serial.print(F("System will power down in "));
     if (runmode != RESET)
       Serial.print(WEBSERVER_TIMEOUT_NOOP);
@@ -143,32 +186,33 @@ void setup() {
 
 
 void loop() {
-  static uint32_t failureStateSecs, failureCountdown, runtimeCounterSecs = 1;
+  static uint32_t failureStateSecs, failureCountdown, runtimeCounterSecs = resume_runtime() + 1;
   static uint32_t prevSecond, prevReadings = millis()/1000;
 
   // check for webserver timeout and handle browser requests
   if (!webserver_stop(false))
     webserver.handleClient();
 
-  // initial warmup for scd30 co2 sensor
-  if (millis()/1000 <= SCD30_WARMUP_SECS) {
+  // initial warmup for scd30 co2 sensor (skipped after deep sleep)
+  if (!resumed && millis()/1000 <= scd30_warmup()) {
     if (co2status == NODATA) {
       Serial.print(F("System warm up, starting periodic sensor readings in "));
-      Serial.print(SCD30_WARMUP_SECS - millis()/1000);
+      Serial.print(scd30_warmup() - millis()/1000);
       Serial.println(F(" seconds..."));
       co2status = WARMUP;
       set_leds(HALF_RING, WHITE);
-      scd30_warmup_countdown = SCD30_WARMUP_SECS - int(millis()/1000);
+      scd30_warmup_countdown = scd30_warmup() - int(millis()/1000);
       logReadings(runtimeCounterSecs);
     }
 
   // do not query sensors in state CALIBRATE, FAILURE or NOOP
   } else if (co2status < CALIBRATE && 
-      (millis()/1000 - prevReadings >= max(5, int(settings.co2ReadingInterval)))) { // lower limit 5 sec.
+      (millis()/1000 - prevReadings >= sensors_interval())) {
     prevReadings = millis()/1000;
     //rtc_temperature();
     bme280_readings(true);
     if (scd30_readings(false)) {
+      scd30_learnSelfHeating();
       if (scd30_co2ppm < CO2_LOWER_BOUND) {
         if (co2status != NODATA) {
           co2status = NODATA;
@@ -209,15 +253,27 @@ void loop() {
         clear_leds(FULL_RING);
         logReadings(runtimeCounterSecs);
     }
+    snapshot_update(); // once per sampling cycle
+    exposure_update(snapshot.status, snapshot.co2ppm, rtc_local());
   }
 
   // main control loop for periodic actions
   if (millis() - prevSecond >= 1000) { // once every seconds
     prevSecond = millis();
 
+    // status changes without new readings (e.g. NOOP, CALIBRATE)
+    if (co2status != snapshot.status)
+      snapshot_update();
+
+    wifi_handle();
+    mqtt_loop();
+    selfheat_inputs(WiFi.getMode() != WIFI_OFF, leds_on(), scd30_interval());
+
     // stop local AP if webserver has stopped
     if (webserver_stop(false))
       wifi_hotspot(true);
+    else
+      webserver_events();
 
     // switch off wifi after webserver timeout unless MQTT push is enabled
     if (!mqttSettings.enabled && webserver_stop(false) && wifi_uplink(false)) {
@@ -241,16 +297,10 @@ void loop() {
       checkNOOPTime(settings.beginSleep, settings.endSleep);
       if (co2status == NOOP) {
         webserver_settimeout(WEBSERVER_TIMEOUT_NOOP);
-        if (webserver_stop(false)) { // wait for webserver to terminate
-          if ((getHourLocal() == settings.endSleep-1) || (getHourLocal() == 23 && !settings.endSleep))
-            enterDeepSleep((60-rtc.now().minute())*60);
-          else if (getHourLocal() == settings.endSleep)
-            // triggered on race condition (system wake up few seconds before endSleep hour)
-            // need to enforce a restart; only way to leave NOOP is to re-run setup()
-            enterDeepSleep(10);
-          else
-            enterDeepSleep(3600);
-        }
+        // sleep until end of NOOP time (chained if longer than 71 minutes);
+        // only way to leave NOOP is to re-run setup() after wake up
+        if (webserver_stop(false)) // wait for webserver to terminate
+          enterDeepSleep(noopRemainingSecs());
       }
     }
 
@@ -260,13 +310,8 @@ void loop() {
 
       if (!(runtimeCounterSecs % mqttSettings.pushInterval)) {
         if (mqttSettings.enabled) {
-          if (wifi_uplink(true)) { // reconnect if necessary
-            mqtt_send(500);  // will implicitly call mqtt_init()
-          } else {
-            Serial.println("MQTT: no WiFi uplink, cannot publish readings.");
-            logMsg("mqtt failed (no wifi)");
-            mqtt_stop();
-          }
+          wifi_uplink(true);  // triggers reconnect in background if necessary
+          mqtt_send(500);  // will implicitly call mqtt_init(), queues readings if offline
         } else {
           mqtt_stop();
         }
@@ -299,14 +344,20 @@ void loop() {
       if (scd30_warmup_countdown > 1)
         scd30_warmup_countdown--;
 
-      if (!(runtimeCounterSecs % SCD30_OFFSET_UPDATES_SECS)) {
+      if (!(runtimeCounterSecs % SCD30_OFFSET_UPDATES_SECS))
         scd30_pressure(bme280_pressure);
-        scd30_adjustTempOffset();
-      }
 
       // check for log rotation every hour
       if (settings.enableLogging && !(runtimeCounterSecs % 3600))
         rotateLogs();
+      if (!(runtimeCounterSecs % 3600))
+        saveSelfheat();
+
+      if (!(runtimeCounterSecs % I2C_STATS_SECS))
+        i2c_stats();
+
+      if (!(runtimeCounterSecs % BATTERY_SAMPLE_SECS))
+        battery_sample(snapshot.vbat);
 
     } // end !NOOP
 
@@ -346,4 +397,10 @@ void loop() {
     }
     runtimeCounterSecs++;
   }
+
+  // in low power mode idle until next second once webserver has stopped
+  // instead of spinning in loop(); lets the WiFi stack enter light sleep
+  if (powerSettings.lowPower && webserver_stop(false) && co2status != CALIBRATE &&
+      millis() - prevSecond < 1000)
+    delay(1000 - (millis() - prevSecond));
 }
@@ -0,0 +1,136 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "baseline.h"
+#include "sensors.h"
+#include "rtc.h"
+#include "utils.h"
+
+// automatic baseline correction: the lowest daily low percentile over
+// the past days is expected to be close to outdoor level, larger
+// deviations are corrected in small forced recalibration steps
+static baseline_t baseline;
+
+static_assert(offsetof(baseline_t, crc) <= UCHAR_MAX, "baseline_t too large for CRC");
+
+
+// low percentile of current day in ppm, 0 if too few readings
+static uint16_t dailyPercentile() {
+  uint32_t total = 0, sum = 0;
+  uint8_t i;
+
+  for (i = 0; i < BASELINE_BINS; i++)
+    total += baseline.hist[i];
+  if (total < BASELINE_MIN_SAMPLES)
+    return 0;
+  for (i = 0; i < BASELINE_BINS; i++) {
+    sum += baseline.hist[i];
+    if (sum * 100 >= total * BASELINE_PERCENTILE)
+      break;
+  }
+  return CO2_LOWER_BOUND + i * BASELINE_BIN_PPM + BASELINE_BIN_PPM/2;
+}
+
+
+// store percentile of past day and check for drift
+static void closeDay() {
+  uint16_t p = dailyPercentile(), low = UINT16_MAX;
+  int16_t drift;
+  char buf[64];
+
+  memset(baseline.hist, 0, sizeof(baseline.hist));
+  if (baseline.cooldown)
+    baseline.cooldown--;
+  if (p) {
+    baseline.daily[baseline.head] = p;
+    baseline.head = (baseline.head + 1) % BASELINE_DAYS;
+    if (baseline.days < BASELINE_DAYS)
+      baseline.days++;
+  }
+
+  if (baseline.days >= BASELINE_MIN_DAYS) {
+    for (uint8_t i = 0; i < baseline.days; i++)
+      low = min(low, baseline.daily[i]);
+    drift = int16_t(low) - SCD30_CO2_CALIBRATION_VALUE;
+    Serial.printf("Baseline: %dppm over %d days, drift %+dppm\n", low, baseline.days, drift);
+    sprintf(buf, "baseline %dppm (%d days)", low, baseline.days);
+    logMsg(buf);
+
+    if (abs(drift) > BASELINE_DEADBAND_PPM && !baseline.cooldown && !baseline.pending) {
+      baseline.pending = constrain(-drift, -BASELINE_MAX_STEP_PPM, BASELINE_MAX_STEP_PPM);
+      if (abs(baseline.correction + baseline.pending) > BASELINE_MAX_TOTAL_PPM) {
+        Serial.println(F("Baseline: drift too large, manual calibration required!"));
+        logMsg("baseline drift too large");
+        baseline.pending = 0;
+      } else {
+        sprintf(buf, "baseline correction %+dppm pending", baseline.pending);
+        logMsg(buf);
+      }
+    }
+  }
+  saveBaseline();
+}
+
+
+// add valid reading to histogram of current day
+void baseline_add(uint16_t co2ppm) {
+  uint32_t t = rtc_local();
+  uint16_t bin;
+
+  if (co2ppm < CO2_LOWER_BOUND)
+    return;
+  if (t) {
+    if (baseline.dayStart && baseline.dayStart != t - t % 86400)
+      closeDay();
+    baseline.dayStart = t - t % 86400;
+  }
+
+  bin = min((co2ppm - CO2_LOWER_BOUND) / BASELINE_BIN_PPM, BASELINE_BINS - 1);
+  if (baseline.hist[bin] < UINT16_MAX)
+    baseline.hist[bin]++;
+}
+
+
+// correction in ppm to be applied with next stable reading
+int16_t baseline_pending() {
+  return baseline.pending;
+}
+
+
+// sensor readings are shifted by step from now on, so are past percentiles
+void baseline_applied(int16_t step) {
+  for (uint8_t i = 0; i < baseline.days; i++)
+    baseline.daily[i] += step;
+  baseline.correction += step;
+  baseline.pending = 0;
+  baseline.cooldown = BASELINE_COOLDOWN_DAYS;
+  saveBaseline();
+}
+
+
+// start over after manual calibration
+void baseline_reset() {
+  memset(&baseline, 0, sizeof(baseline));
+  saveBaseline();
+}
+
+
+void loadBaseline() {
+  baseline_t buf;
+
+  memset(&baseline, 0, sizeof(baseline));
+  loadSettings(&baseline, &buf, offsetof(baseline_t, crc), EEPROM_BASELINE_ADDR, "baseline");
+}
+
+
+bool saveBaseline() {
+  baseline.crc = crc16((uint8_t *) &baseline, offsetof(baseline_t, crc));
+  return saveSettings(baseline, EEPROM_BASELINE_ADDR, "baseline");
+}
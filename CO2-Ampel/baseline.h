@@ -0,0 +1,48 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _BASELINE_H
+#define _BASELINE_H
+
+#include <Arduino.h>
+
+#define EEPROM_BASELINE_ADDR 0xB00
+#define BASELINE_BIN_PPM 8
+#define BASELINE_BINS 64  // histogram from CO2_LOWER_BOUND to 862 ppm
+#define BASELINE_PERCENTILE 5  // daily low percentile
+#define BASELINE_DAYS 14
+#define BASELINE_MIN_DAYS 7
+#define BASELINE_MIN_SAMPLES 100  // per day
+#define BASELINE_DEADBAND_PPM 30  // tolerated deviation from outdoor level
+#define BASELINE_MAX_STEP_PPM 30  // per correction
+#define BASELINE_MAX_TOTAL_PPM 200  // manual calibration required beyond
+#define BASELINE_COOLDOWN_DAYS 3  // between corrections
+
+// histogram of current day and low percentiles of past days
+typedef struct {
+  uint16_t hist[BASELINE_BINS];
+  uint16_t daily[BASELINE_DAYS];
+  uint32_t dayStart;  // local time
+  uint8_t head;
+  uint8_t days;
+  uint8_t cooldown;  // days
+  int16_t pending;  // correction waiting for stable readings
+  int16_t correction;  // sum of applied corrections since last calibration
+  uint16_t crc = 0;
+} baseline_t;
+
+void baseline_add(uint16_t co2ppm);
+int16_t baseline_pending();
+void baseline_applied(int16_t step);
+void baseline_reset();
+void loadBaseline();
+bool saveBaseline();
+
+#endif
@@ -0,0 +1,190 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "battery.h"
+#include "lorawan.h"
+#include "logging.h"
+#include "utils.h"
+#include "rtc.h"
+
+// Li-ion open circuit voltage (mV) vs. state of charge (%), 0% is
+// set to VBAT_DEEPSLEEP_MV since the system powers down at this level
+static const uint16_t socCurve[][2] PROGMEM = {
+  { 4200, 100 }, { 4150, 95 }, { 4110, 90 }, { 4080, 85 }, { 4020, 80 },
+  { 3980, 70 }, { 3950, 60 }, { 3910, 50 }, { 3870, 40 }, { 3850, 30 },
+  { 3840, 20 }, { 3820, 15 }, { 3800, 10 }, { 3750, 5 }, { VBAT_DEEPSLEEP_MV, 0 }
+};
+#define SOC_POINTS (sizeof(socCurve) / sizeof(socCurve[0]))
+
+static batterysample_t samples[BATTERY_SAMPLES];
+static uint8_t numSamples = 0, nextSample = 0;
+static bool samplesLocalTime = false;
+
+
+// returns current time for samples, local time if valid else uptime
+static uint32_t sampleTime(bool *localTime) {
+  time_t t = rtc_local();
+
+  *localTime = (t > 1605441600);
+  return *localTime ? t : millis()/1000;
+}
+
+
+static void addSample(uint32_t t, bool localTime, uint16_t soc) {
+  // time base has changed (e.g. first NTP sync), restart fit
+  if (numSamples && localTime != samplesLocalTime)
+    numSamples = 0;
+  samplesLocalTime = localTime;
+  samples[nextSample].time = t;
+  samples[nextSample].soc = soc;
+  nextSample = (nextSample + 1) % BATTERY_SAMPLES;
+  if (numSamples < BATTERY_SAMPLES)
+    numSamples++;
+}
+
+
+// returns state of charge in permille for given open circuit voltage
+static uint16_t socPermille(uint16_t ocv) {
+  uint16_t v0, v1, s0, s1;
+
+  if (ocv >= pgm_read_word(&socCurve[0][0]))
+    return 1000;
+  for (uint8_t i = 1; i < SOC_POINTS; i++) {
+    v1 = pgm_read_word(&socCurve[i][0]);
+    if (ocv >= v1) {
+      v0 = pgm_read_word(&socCurve[i-1][0]);
+      s0 = pgm_read_word(&socCurve[i-1][1]);
+      s1 = pgm_read_word(&socCurve[i][1]);
+      return s1 * 10 + uint32_t(ocv - v1) * (s0 - s1) * 10 / (v0 - v1);
+    }
+  }
+  return 0;
+}
+
+
+// returns battery voltage (mV) compensated for the voltage drop
+// caused by the current load (WiFi, LoRaWAN transmissions)
+uint16_t battery_ocv(uint16_t vbat) {
+  uint16_t load = BATTERY_LOAD_BASE_MA;
+
+  if (vbat <= VBAT_CONNECTED_MV)
+    return 0;
+  if (WiFi.getMode() != WIFI_OFF)
+    load += BATTERY_LOAD_WIFI_MA;
+#ifdef HAS_LORAWAN_SHIELD
+  if (lmic_busy())
+    load += BATTERY_LOAD_LORA_MA;
+#endif
+  return vbat + uint32_t(load) * BATTERY_RESISTANCE_MOHM / 1000;
+}
+
+
+// returns state of charge (0-100%) for given battery voltage
+uint8_t battery_soc(uint16_t vbat) {
+  return (socPermille(battery_ocv(vbat)) + 5) / 10;
+}
+
+
+// add state of charge to samples for slope fit, called every BATTERY_SAMPLE_SECS
+void battery_sample(uint16_t vbat) {
+  uint32_t t;
+  bool localTime;
+
+  if (vbat <= VBAT_CONNECTED_MV)  // no battery connected
+    return;
+  t = sampleTime(&localTime);
+  addSample(t, localTime, socPermille(battery_ocv(vbat)));
+}
+
+
+// seed samples with battery voltages from logged readings, so a
+// runtime estimate is available right after a restart
+void battery_load() {
+  tmElements_t tm;
+  int year, month, day, hour, minute, second, commas;
+  uint32_t t, now, prevTime = 0;
+  uint16_t j, vbat;
+  uint8_t count = 0;
+  bool localTime;
+  File logfile;
+  String line;
+
+  now = sampleTime(&localTime);
+  if (!localTime || !settings.enableLogging)
+    return;
+  logfile = LittleFS.open(LOGFILE_NAME, "r");
+  if (!logfile)
+    return;
+
+  while (logfile.available()) {
+    line = logfile.readStringUntil('\n');
+    // readings: timestamp,runtime,status,co2,temp,hum,temp,hum,pressure,vbat
+    for (commas = 0, j = 0; j < line.length(); j++)
+      if (line[j] == ',')
+        commas++;
+    if (commas != 9 || sscanf(line.c_str(), "%d-%d-%dT%d:%d:%d",
+        &year, &month, &day, &hour, &minute, &second) != 6)
+      continue;
+    tm.Year = CalendarYrToTm(year);
+    tm.Month = month;
+    tm.Day = day;
+    tm.Hour = hour;
+    tm.Minute = minute;
+    tm.Second = second;
+    t = makeTime(tm);
+    if (t + BATTERY_SAMPLES * BATTERY_SAMPLE_SECS < now || t > now ||
+        t - prevTime < BATTERY_SAMPLE_SECS)
+      continue;
+    line = line.substring(line.lastIndexOf(',') + 1);
+    vbat = line.toFloat() * 1000;
+    if (vbat <= VBAT_CONNECTED_MV)
+      continue;
+    // load at logging time unknown, assume base load
+    addSample(t, true, socPermille(vbat + BATTERY_LOAD_BASE_MA * BATTERY_RESISTANCE_MOHM / 1000));
+    prevTime = t;
+    count++;
+  }
+  logfile.close();
+  Serial.printf("Battery: %d samples loaded from log file.\n", count);
+}
+
+
+// returns expected hours until battery is empty (VBAT_DEEPSLEEP_MV) based
+// on a least squares fit of the state of charge over the last hours,
+// -1 if unknown (too few samples, charging)
+int16_t battery_hours() {
+  float sx = 0, sy = 0, sxy = 0, sxx = 0, x, slope, soc, hours;
+  uint32_t t0;
+  uint8_t i, idx;
+
+  if (numSamples < BATTERY_MIN_SAMPLES)
+    return -1;
+
+  t0 = samples[(nextSample + BATTERY_SAMPLES - numSamples) % BATTERY_SAMPLES].time;
+  for (i = 0; i < numSamples; i++) {  // oldest sample first
+    idx = (nextSample + BATTERY_SAMPLES - numSamples + i) % BATTERY_SAMPLES;
+    x = (samples[idx].time - t0) / 3600.0;  // hours
+    sx += x;
+    sy += samples[idx].soc;
+    sxy += x * samples[idx].soc;
+    sxx += x * x;
+  }
+  if (numSamples * sxx - sx * sx <= 0)
+    return -1;
+  slope = (numSamples * sxy - sx * sy) / (numSamples * sxx - sx * sx);  // permille per hour
+  if (slope >= 0)
+    return -1;
+
+  soc = (sy - slope * sx) / numSamples + slope * x;  // fitted current value
+  if (soc <= 0)
+    return 0;
+  hours = soc / -slope;
+  return (hours < INT16_MAX) ? int16_t(hours) : INT16_MAX;
+}
@@ -0,0 +1,38 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _BATTERY_H
+#define _BATTERY_H
+
+#include <Arduino.h>
+
+#define BATTERY_SAMPLE_SECS 600
+#define BATTERY_SAMPLES 36  // slope over last 6 hours
+#define BATTERY_MIN_SAMPLES 6
+
+// estimated load currents and internal resistance (incl. wiring)
+// of two 18650 cells in parallel to compensate voltage drop
+#define BATTERY_RESISTANCE_MOHM 150
+#define BATTERY_LOAD_BASE_MA 40  // ESP8266 (modem sleep), SCD30, BME280
+#define BATTERY_LOAD_WIFI_MA 70
+#define BATTERY_LOAD_LORA_MA 120
+
+typedef struct {
+  uint32_t time;  // local time or uptime in secs
+  uint16_t soc;  // permille
+} batterysample_t;
+
+uint16_t battery_ocv(uint16_t vbat);
+uint8_t battery_soc(uint16_t vbat);
+void battery_sample(uint16_t vbat);
+void battery_load();
+int16_t battery_hours();
+
+#endif
@@ -33,11 +33,31 @@
 // number of samples used for CO2 median reading
 #define SCD30_INTERVAL_SECS 10
 #define SCD30_NUM_SAMPLES_MEDIAN 6
+// filter for CO2 readings: CO2_FILTER_NONE, CO2_FILTER_MEDIAN or
+// CO2_FILTER_KALMAN (follows rising levels without the median's lag)
+#define CO2_FILTER CO2_FILTER_MEDIAN
 //#define SCD30_DEBUG
 
+// correct SCD30 drift in small steps, requires fresh air at least
+// once a week (see baseline.h); manual calibration resets correction
+#define SCD30_AUTO_BASELINE
+
+// low power mode for battery operation (CD_AN_SCD30_Low_Power_Mode_D2.pdf),
+// SCD30 measures once a minute, ESP idles between readings
+//#define ENABLE_LOWPOWER
+
 // altitude compensation for air sensor
 #define ALTITUDE_ABOVE_SEELEVEL 125
 
+// BME280 oversampling (OSR_X1...OSR_X16) and IIR filter (Filter_Off,
+// Filter_2...Filter_16); conversions are triggered in forced mode, keep
+// oversampling low to reduce self-heating and power consumption
+// NOTE: cannot be changed in web interface
+#define BME280_OVERSAMPLING_TEMP BME280::OSR_X1
+#define BME280_OVERSAMPLING_HUM BME280::OSR_X1
+#define BME280_OVERSAMPLING_PRES BME280::OSR_X1
+#define BME280_FILTER BME280::Filter_Off
+
 // logging to local flash filesystem (LittleFS)
 #define ENABLE_LOGGING
 #define LOGGING_INTERVAL_SECS 300
@@ -81,6 +101,8 @@
 #define MQTT_PUSH_JSON
 //#define MQTT_USER "ampel"
 //#define MQTT_PASS "__secret__"
+// publish Home Assistant discovery configs (not with MQTT_PUSH_JSON)
+#define MQTT_HA_DISCOVERY "homeassistant"
 
 // uncomment HAS_LORAWAN_SHIELD to compile in LoRaWAN support
 // recommended shield for a Wemos D1: https://github.com/hallard/WeMos-Lora
@@ -0,0 +1,122 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "exposure.h"
+#include "rtc.h"
+#include "utils.h"
+
+static exposures_t exposure;
+
+// crc16() takes an 8 bit length
+static_assert(offsetof(exposures_t, crc) <= UCHAR_MAX, "exposures_t too large for CRC");
+
+
+// local time at which the window containing t started
+static uint32_t windowStart(uint8_t w, uint32_t t) {
+  switch (w) {
+    case EXPOSURE_HOUR:
+      return t - t % 3600;
+    case EXPOSURE_DAY:
+      return t - t % 86400;
+    default:  // weeks start on monday, weekday() is 1 on sunday
+      return t - t % 86400 - ((weekday(t) + 5) % 7) * 86400UL;
+  }
+}
+
+
+// adds time since last update to current status and the excess
+// concentration to the ppm * min above each threshold, all windows
+// are updated in place, so each reading takes constant time
+void exposure_update(sensorStatus status, uint16_t co2ppm, uint32_t local) {
+  uint16_t thresholds[3] = { settings.co2MediumThreshold,
+    settings.co2HighThreshold, settings.co2AlarmThreshold };
+  uint32_t start, dt = 0, ppmSecs, ppmMins;
+  bool rollover = false;
+  uint8_t w, k;
+
+  if (!local)  // no valid time
+    return;
+
+  for (w = EXPOSURE_HOUR; w <= EXPOSURE_WEEK; w++) {
+    start = windowStart(w, local);
+    if (exposure.current[w].start != start) {
+      if (exposure.current[w].start)
+        exposure.last[w] = exposure.current[w];
+      memset(&exposure.current[w], 0, sizeof(exposure_t));
+      exposure.current[w].start = start;
+      rollover = true;
+    }
+  }
+
+  if (exposure.lastUpdate && local > exposure.lastUpdate && local - exposure.lastUpdate <= EXPOSURE_MAX_GAP_SECS)
+    dt = local - exposure.lastUpdate;
+  exposure.lastUpdate = local;
+
+  if (status >= GOOD && status <= ALARM) {
+    for (w = EXPOSURE_HOUR; w <= EXPOSURE_WEEK; w++) {
+      exposure.current[w].secs[status - GOOD] += dt;
+      if (co2ppm > exposure.current[w].peak)
+        exposure.current[w].peak = co2ppm;
+    }
+    for (k = 0; k < 3; k++) {
+      if (co2ppm <= thresholds[k])
+        continue;
+      ppmSecs = exposure.ppmSecs[k] + uint32_t(co2ppm - thresholds[k]) * dt;
+      ppmMins = ppmSecs / 60;
+      exposure.ppmSecs[k] = ppmSecs % 60;
+      for (w = EXPOSURE_HOUR; w <= EXPOSURE_WEEK; w++)
+        exposure.current[w].ppmMins[k] += ppmMins;
+    }
+  }
+
+  // at most one EEPROM write per hour
+  if (rollover)
+    saveExposure();
+}
+
+
+// local start time of current hour, changes on each rollover
+uint32_t exposure_hour() {
+  return exposure.current[EXPOSURE_HOUR].start;
+}
+
+
+const char* exposure_name(exposureWindow w, bool last) {
+  static const char* const names[2][3] = {
+    { "hour", "day", "week" },
+    { "lastHour", "lastDay", "lastWeek" }
+  };
+  return names[last][w];
+}
+
+
+// returns length of JSON string written to buf
+size_t exposure_json(exposureWindow w, bool last, char (&buf)[exposureJSON::size]) {
+  const exposure_t &e = last ? exposure.last[w] : exposure.current[w];
+
+  return exposureJSON::write(buf, e.start,
+    e.secs[0], e.secs[1], e.secs[2], e.secs[3],
+    e.ppmMins[0], e.ppmMins[1], e.ppmMins[2],
+    e.peak);
+}
+
+
+void loadExposure() {
+  exposures_t buf;
+
+  memset(&exposure, 0, sizeof(exposure));
+  loadSettings(&exposure, &buf, offsetof(exposures_t, crc), EEPROM_EXPOSURE_ADDR, "exposure");
+}
+
+
+bool saveExposure() {
+  exposure.crc = crc16((uint8_t *) &exposure, offsetof(exposures_t, crc));
+  return saveSettings(exposure, EEPROM_EXPOSURE_ADDR, "exposure");
+}
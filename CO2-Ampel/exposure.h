@@ -0,0 +1,69 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _EXPOSURE_H
+#define _EXPOSURE_H
+
+#include <Arduino.h>
+#include "sensors.h"
+#include "jsonwriter.h"
+
+#define EEPROM_EXPOSURE_ADDR 0xA00
+#define EXPOSURE_MAX_GAP_SECS 600  // longer gaps (e.g. deep sleep) are not counted
+
+enum exposureWindow {
+  EXPOSURE_HOUR,
+  EXPOSURE_DAY,
+  EXPOSURE_WEEK
+};
+
+typedef struct {
+  uint32_t start;  // local time
+  uint32_t secs[4];  // time in status GOOD, MEDIUM, CRITICAL and ALARM
+  uint32_t ppmMins[3];  // ppm * min above medium, high and alarm threshold
+  uint16_t peak;  // ppm
+} exposure_t;
+
+// current and last completed hour, day and week (starting on monday)
+typedef struct {
+  exposure_t current[3];
+  exposure_t last[3];
+  uint16_t ppmSecs[3];  // carry below one ppm * min
+  uint32_t lastUpdate;  // local time
+  uint16_t crc = 0;
+} exposures_t;
+
+namespace jsonkey {
+  JSON_KEY(start); JSON_KEY(good); JSON_KEY(medium); JSON_KEY(critical);
+  JSON_KEY(alarm); JSON_KEY(ppmMinMedium); JSON_KEY(ppmMinHigh); JSON_KEY(ppmMinAlarm);
+  JSON_KEY(peak);
+}
+
+// single window as JSON, times in secs, doses in ppm * min
+typedef json::Object<
+  json::Field<jsonkey::start, json::UInt32>,
+  json::Field<jsonkey::good, json::UInt32>,
+  json::Field<jsonkey::medium, json::UInt32>,
+  json::Field<jsonkey::critical, json::UInt32>,
+  json::Field<jsonkey::alarm, json::UInt32>,
+  json::Field<jsonkey::ppmMinMedium, json::UInt32>,
+  json::Field<jsonkey::ppmMinHigh, json::UInt32>,
+  json::Field<jsonkey::ppmMinAlarm, json::UInt32>,
+  json::Field<jsonkey::peak, json::UInt16>
+> exposureJSON;
+
+void exposure_update(sensorStatus status, uint16_t co2ppm, uint32_t local);
+uint32_t exposure_hour();
+const char* exposure_name(exposureWindow w, bool last);
+size_t exposure_json(exposureWindow w, bool last, char (&buf)[exposureJSON::size]);
+void loadExposure();
+bool saveExposure();
+
+#endif
@@ -0,0 +1,94 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "config.h"
+#include "fixedpoint.h"
+
+
+// integer square root, bit by bit
+uint32_t isqrt(uint64_t v) {
+  uint64_t root = 0, bit = 1ULL << 62;
+
+  while (bit > v)
+    bit >>= 2;
+  while (bit) {
+    if (v >= root + bit) {
+      v -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+
+// returns standard deviation of given running median readings
+// (integer values) in 1/100 of their unit using integer math only
+uint32_t stdDev(RunningMedian &readings, bool debug) {
+  int32_t average = 0, diff;
+  uint64_t sqDevSum = 0;
+  uint32_t deviation;
+  uint8_t count = readings.getCount();
+
+  if (count < 5)
+    return UCHAR_MAX * 100;
+
+  for (uint8_t i = 0; i < count; i++)
+    average += int32_t(readings.getElement(i));
+  average = average * 100 / count;
+  for (uint8_t i = 0; i < count; i++) {
+    diff = average - int32_t(readings.getElement(i)) * 100;
+    sqDevSum += int64_t(diff) * diff;
+  }
+  deviation = isqrt(sqDevSum / count);
+
+  if (debug) {
+    Serial.print(F("Values: "));
+    for (uint8_t i = 0; i < readings.getCount(); i++) {
+      Serial.print(readings.getElement(i));
+      Serial.print(" ");
+    }
+    Serial.println();
+    Serial.print(F("Mean: " ));
+    Serial.println(average/100.0);
+    Serial.print(F("Sigma: "));
+    Serial.println(deviation/100.0);
+  }
+
+  return deviation;
+}
+
+
+// ratio of saturation vapor pressures over water at t1 and t2
+// (Magnus formula) in 1/65536, temperatures in centi-°C; exp() of the
+// exponent difference is a Taylor series, accurate to 0.03% for
+// differences up to SELFHEAT_OFFSET_MAX
+uint32_t magnusRatio(int16_t t1, int16_t t2) {
+  int64_t d, p, e;
+
+  // 17.62 * t / (243.12 + t) with t in centi-°C, difference for t1 and t2
+  d = (int64_t(428377) * (t1 - t2) << 16) / ((24312L + t1) * (24312L + t2));
+  e = 65536 + d;
+  p = d;
+  for (uint8_t n = 2; n <= 4; n++) {
+    p = (p * d >> 16) / n;
+    e += p;
+  }
+  return e;
+}
+
+
+// battery voltage (mV) from the sum of ADC samples, VBAT_ADJUST is
+// the voltage divider's full scale (V) and constant-folded to mV
+uint16_t adc_vbat_mv(uint32_t raw, uint8_t samples) {
+  return raw * uint32_t(VBAT_ADJUST * 1000) / (samples * 1024UL);
+}
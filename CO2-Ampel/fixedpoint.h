@@ -0,0 +1,23 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _FIXEDPOINT_H
+#define _FIXEDPOINT_H
+
+#include <Arduino.h>
+#include <RunningMedian.h>
+
+// integer math of the sensor data path, the ESP8266 has no FPU
+uint32_t isqrt(uint64_t v);
+uint32_t stdDev(RunningMedian &readings, bool debug);
+uint32_t magnusRatio(int16_t t1, int16_t t2);
+uint16_t adc_vbat_mv(uint32_t raw, uint8_t samples);
+
+#endif
@@ -0,0 +1,78 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "format.h"
+
+static const uint32_t pow10[] = { 1, 10, 100, 1000, 10000, 100000 };
+
+
+// unsigned integer as decimal without leading zeros
+char* fmt_uint(char *buf, uint32_t value) {
+  char digits[10];
+  uint8_t n = 0;
+
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (n)
+    *buf++ = digits[--n];
+  *buf = '\0';
+  return buf;
+}
+
+
+char* fmt_int(char *buf, int32_t value) {
+  if (value < 0) {
+    *buf++ = '-';
+    return fmt_uint(buf, -uint32_t(value));
+  }
+  return fmt_uint(buf, value);
+}
+
+
+// fixed-point value with 10^scale units (e.g. scale 2 for
+// centi-°C) with given number of decimals, rounded half away
+// from zero like dtostrf(); scale and decimals must be <= 5
+char* fmt_fixed(char *buf, int32_t value, uint8_t scale, uint8_t decimals) {
+  uint32_t u, frac;
+  uint8_t i;
+
+  if (value < 0) {
+    *buf++ = '-';
+    u = -uint32_t(value);
+  } else {
+    u = value;
+  }
+  if (decimals < scale)
+    u = (u + pow10[scale - decimals] / 2) / pow10[scale - decimals];
+  else
+    u *= pow10[decimals - scale];
+
+  buf = fmt_uint(buf, u / pow10[decimals]);
+  if (decimals) {
+    *buf++ = '.';
+    frac = u % pow10[decimals];
+    for (i = decimals; i > 0; i--) {
+      buf[i-1] = '0' + frac % 10;
+      frac /= 10;
+    }
+    buf += decimals;
+    *buf = '\0';
+  }
+  return buf;
+}
+
+
+char* fmt_char(char *buf, char c) {
+  *buf++ = c;
+  *buf = '\0';
+  return buf;
+}
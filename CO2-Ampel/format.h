@@ -0,0 +1,23 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _FORMAT_H
+#define _FORMAT_H
+
+#include <Arduino.h>
+
+// all functions write a null terminated string into the caller's
+// buffer and return a pointer to its end for appending more text
+char* fmt_uint(char *buf, uint32_t value);
+char* fmt_int(char *buf, int32_t value);
+char* fmt_fixed(char *buf, int32_t value, uint8_t scale, uint8_t decimals);
+char* fmt_char(char *buf, char c);
+
+#endif
@@ -47,6 +47,7 @@ var suspendReadings = false;
 var calibrationInProgress = false;
 var co2status = 0; // no data
 var prevCO2status = 0;
+var webserverTimeout = -1;
 
 function hideMessages() {
   document.getElementById("timeoutInfo").style.display = "none";
@@ -105,142 +106,212 @@ function getSetup() {
       if (arr[1] == "1") { // Logging enabled?    
         document.getElementById("logfile_download").style.display = "block";
       }
+      if (arr[2] > 0) { // boot time in ms, phases as tooltip
+        document.getElementById("BootTime").innerHTML = (arr[2]/1000).toFixed(1);
+        document.getElementById("BootTime").title = arr[3].split(';').join(', ');
+      }
     }    
   };
   xhttp.open("GET", "/setup", true);
   xhttp.send();
 }
 
-function getReadings() {
-  var xhttp = new XMLHttpRequest();
-  var res;
-  var timeout;
+function showWebserverTimeout() {
+  document.getElementById("WebserverTimeout").innerHTML = webserverTimeout > 60 ? Math.round(webserverTimeout/60) + " Min." : webserverTimeout + " Sek.";
+}
+
+// count down webserver timeout between pushed readings
+function tickWebserverTimeout() {
+  if (suspendReadings || webserverTimeout <= 0)
+    return;
+  webserverTimeout--;
+  showWebserverTimeout();
+  if (!webserverTimeout)
+    webserverOffline();
+}
+
+function updateReadings(res) {
   var height = 0;
   var lorawanMode = -1;
 
-  if (suspendReadings)
-    return;
- 
-  xhttp.onreadystatechange = function() {
-    if (this.readyState == 4 && this.status == 200) {
-      res = JSON.parse(xhttp.responseText);
-      document.getElementById("Date").innerHTML = res.date;
-      document.getElementById("Time").innerHTML = res.time;
-      document.getElementById("Temp").innerHTML = res.temperature;
-      document.getElementById("CO2").innerHTML = res.co2median;
-      co2status = parseInt(res.co2status); // see config.h
-      document.getElementById("Hum").innerHTML = res.humidity;
-      document.getElementById("Pres").innerHTML = res.pressure;
-      batteryVoltage = parseFloat(res.vbat);
-      if (batteryVoltage > 0) {
-        document.getElementById("VBat").innerHTML = res.vbat;
-      }
-      webserverTimeout = parseInt(res.webserverTimeout);
-      document.getElementById("WebserverTimeout").innerHTML = webserverTimeout > 60 ? Math.round(webserverTimeout/60) + " Min." : webserverTimeout + " Sek.";
-      calibrationTimeout = parseInt(res.calibrationTimeout);
-      document.getElementById("CalibrationTimeout").innerHTML = calibrationTimeout;
-      warmupTimeout = parseInt(res.warmupTimeout);
-      document.getElementById("WarmupTimeout").innerHTML = warmupTimeout;
-      mqttCounter = parseInt(res.mqttMessages)
-      document.getElementById("MqttCounter").innerHTML = mqttCounter;
-      document.getElementById("LoRaDevAddr").innerHTML = res.loraDevAddr;
-      document.getElementById("LoRaSeqnoUp").innerHTML = res.loraSeqnoUp;
-      lorawanMode = parseInt(res.otaa);
-
-      if (calibrationInProgress || calibrationTimeout > 0) {
-        if (co2status != 6) {  // calibration ended
-          calibrationInProgress = true;
-          document.getElementById("calibrateInfo").style.display = "none";
-          if (co2status != 7) {
-            document.getElementById("calibrateDone").style.display = "block";
-          } else {
-            document.getElementById("calibrateFailed").style.display = "block";
-          }
-          // preserve closing calibration status message for a few seconds
-          setTimeout(function(){ calibrationInProgress = false; }, 3000);
-        } else {  // calibration ongoing
-          document.getElementById("calibrateInfo").style.display = "block";
-          document.getElementById("CO2").innerHTML = "----";
-        }
-        height += 12;
+  document.getElementById("Date").innerHTML = res.date;
+  document.getElementById("Time").innerHTML = res.time;
+  document.getElementById("Temp").innerHTML = res.temperature;
+  document.getElementById("CO2").innerHTML = res.co2median;
+  document.getElementById("Trend").innerHTML = (res.trend > 0 ? "+" : "") + res.trend;
+  if (res.forecast >= 0) {
+    document.getElementById("co2_forecast").style.display = "table-row";
+    document.getElementById("Forecast").innerHTML = res.forecast;
+  } else {
+    document.getElementById("co2_forecast").style.display = "none";
+  }
+  if (res.ach !== undefined) {
+    document.getElementById("air_changes").style.display = "table-row";
+    document.getElementById("ACH").innerHTML = res.ach;
+  }
+  co2status = parseInt(res.co2status); // see config.h
+  document.getElementById("Hum").innerHTML = res.humidity;
+  document.getElementById("Pres").innerHTML = res.pressure;
+  batteryVoltage = parseFloat(res.vbat);
+  if (batteryVoltage > 0) {
+    document.getElementById("VBat").innerHTML = res.vbat;
+    document.getElementById("SoC").innerHTML = " (" + res.soc + "%)";
+    if (res.batteryLife > 0) {
+      document.getElementById("battery_life").style.display = "table-row";
+      document.getElementById("BatteryLife").innerHTML = res.batteryLife > 48 ? Math.round(res.batteryLife/24) + " Tage" : res.batteryLife + " Std.";
+    }
+  }
+  webserverTimeout = parseInt(res.webserverTimeout);
+  showWebserverTimeout();
+  calibrationTimeout = parseInt(res.calibrationTimeout);
+  document.getElementById("CalibrationTimeout").innerHTML = calibrationTimeout;
+  if (res.calibrationSigma !== undefined) {
+    document.getElementById("calibrationBounds").style.display = "inline";
+    document.getElementById("CalibrationSigma").innerHTML = res.calibrationSigma;
+    document.getElementById("CalibrationDrift").innerHTML = res.calibrationDrift;
+  } else {
+    document.getElementById("calibrationBounds").style.display = "none";
+  }
+  warmupTimeout = parseInt(res.warmupTimeout);
+  document.getElementById("WarmupTimeout").innerHTML = warmupTimeout;
+  if (res.rssi < 0) {
+    document.getElementById("wifi_rssi").style.display = "table-row";
+    document.getElementById("RSSI").innerHTML = res.rssi;
+  } else {
+    document.getElementById("wifi_rssi").style.display = "none";
+  }
+  mqttCounter = parseInt(res.mqttMessages)
+  document.getElementById("MqttCounter").innerHTML = mqttCounter;
+  document.getElementById("LoRaDevAddr").innerHTML = res.loraDevAddr;
+  document.getElementById("LoRaSeqnoUp").innerHTML = res.loraSeqnoUp;
+  lorawanMode = parseInt(res.otaa);
+
+  if (calibrationInProgress || calibrationTimeout > 0) {
+    if (co2status != 6) {  // calibration ended
+      calibrationInProgress = true;
+      document.getElementById("calibrateInfo").style.display = "none";
+      if (co2status != 7) {
+        document.getElementById("calibrateDone").style.display = "block";
       } else {
-        document.getElementById("calibrateInfo").style.display = "none";
-        document.getElementById("calibrateDone").style.display = "none";
-        document.getElementById("calibrateFailed").style.display = "none";
+        document.getElementById("calibrateFailed").style.display = "block";
       }
+      // preserve closing calibration status message for a few seconds
+      setTimeout(function(){ calibrationInProgress = false; }, 3000);
+    } else {  // calibration ongoing
+      document.getElementById("calibrateInfo").style.display = "block";
+      document.getElementById("CO2").innerHTML = "----";
+    }
+    height += 12;
+  } else {
+    document.getElementById("calibrateInfo").style.display = "none";
+    document.getElementById("calibrateDone").style.display = "none";
+    document.getElementById("calibrateFailed").style.display = "none";
+  }
 
-      if (co2status == 1) {
-        document.getElementById("warmupInfo").style.display = "block";
-        document.getElementById("CO2").innerHTML = "----";
-        height += 12;
-      } else {
-        document.getElementById("warmupInfo").style.display = "none";
-      }
+  if (co2status == 1) {
+    document.getElementById("warmupInfo").style.display = "block";
+    document.getElementById("CO2").innerHTML = "----";
+    height += 12;
+  } else {
+    document.getElementById("warmupInfo").style.display = "none";
+  }
 
-      if (webserverTimeout > 0 && !calibrationInProgress && prevCO2status != 1 && co2status != 1) {
-        if (webserverTimeout <= 5)
-          setTimeout(webserverOffline, 5000);
-        document.getElementById("timeoutInfo").style.display = "block";
-        height += 12;
-      } else {
-        document.getElementById("timeoutInfo").style.display = "none";
-      }    
+  if (webserverTimeout > 0 && !calibrationInProgress && prevCO2status != 1 && co2status != 1) {
+    if (webserverTimeout <= 5)
+      setTimeout(webserverOffline, 5000);
+    document.getElementById("timeoutInfo").style.display = "block";
+    height += 12;
+  } else {
+    document.getElementById("timeoutInfo").style.display = "none";
+  }    
 
-      if (!co2status && !prevCO2status) {
-        document.getElementById("invalidData").style.display = "block";
-        height += 12;
-      } else {
-        document.getElementById("invalidData").style.display = "none";
-      }
-      
-      if (co2status == 8) {
-        document.getElementById("noopMode").style.display = "block";
-        height += 12;
-      } else {
-        document.getElementById("noopMode").style.display = "none";
-      }
-      prevCO2status = co2status; // used to add small (empty) delay in status messages
+  if (!co2status && !prevCO2status) {
+    document.getElementById("invalidData").style.display = "block";
+    height += 12;
+  } else {
+    document.getElementById("invalidData").style.display = "none";
+  }
+  
+  if (co2status == 8) {
+    document.getElementById("noopMode").style.display = "block";
+    height += 12;
+  } else {
+    document.getElementById("noopMode").style.display = "none";
+  }
+  prevCO2status = co2status; // used to add small (empty) delay in status messages
 
-      if (height > 0) {
-        height += 4;
-        document.getElementById("message").style.height = height + "px";
-      } else {
-        document.getElementById("message").style.display = "none";
-      }
+  if (height > 0) {
+    height += 4;
+    document.getElementById("message").style.height = height + "px";
+  } else {
+    document.getElementById("message").style.display = "none";
+  }
 
-      if (batteryVoltage < 3.70 && batteryVoltage > 0) {
-        document.getElementById("VBatDisplay").style = "font-weight:bold;color:red";
-      } else {
-        document.getElementById("VBatDisplay").style = "font-weight:normal;color:black";
-      }
+  if (batteryVoltage < 3.70 && batteryVoltage > 0) {
+    document.getElementById("VBatDisplay").style = "font-weight:bold;color:red";
+  } else {
+    document.getElementById("VBatDisplay").style = "font-weight:normal;color:black";
+  }
 
-      if (mqttCounter > -1) {
-        document.getElementById("mqtt_msgs").style.display = "table-row";
-      } else {
-        document.getElementById("mqtt_msgs").style.display = "none";
-      }
+  if (mqttCounter > -1) {
+    document.getElementById("mqtt_msgs").style.display = "table-row";
+  } else {
+    document.getElementById("mqtt_msgs").style.display = "none";
+  }
 
-      if (lorawanMode > -1) {
-        document.getElementById("lorawan_addr").style.display = "table-row";
-        document.getElementById("lorawan_seqnoup").style.display = "table-row";
-      }
-      if (lorawanMode > 0) {
-        document.getElementById("LoRaMode").innerHTML = "OTAA"
-      } else if (!lorawanMode) {
-        document.getElementById("LoRaMode").innerHTML = "ABP";
-      } else {
-        document.getElementById("LoRaMode").innerHTML = "Aus";
-      }
+  if (lorawanMode > -1) {
+    document.getElementById("lorawan_addr").style.display = "table-row";
+    document.getElementById("lorawan_seqnoup").style.display = "table-row";
+  }
+  if (lorawanMode > 0) {
+    document.getElementById("LoRaMode").innerHTML = "OTAA"
+  } else if (!lorawanMode) {
+    document.getElementById("LoRaMode").innerHTML = "ABP";
+  } else {
+    document.getElementById("LoRaMode").innerHTML = "Aus";
+  }
+}
+
+function getReadings() {
+  var xhttp = new XMLHttpRequest();
+
+  if (suspendReadings)
+    return;
+ 
+  xhttp.onreadystatechange = function() {
+    if (this.readyState == 4 && this.status == 200) {
+      updateReadings(JSON.parse(xhttp.responseText));
     }
   };
   xhttp.open("GET", "/ui", true);
   xhttp.send();
 }
 
+// readings are pushed by the webserver as server-sent events,
+// fall back to polling if the browser doesn't support them
+function startReadings() {
+  var events;
+
+  if (!window.EventSource) {
+    setInterval(function() { getReadings(); }, 3000);
+    return;
+  }
+  events = new EventSource("/events");
+  events.onmessage = function(e) {
+    if (!suspendReadings)
+      updateReadings(JSON.parse(e.data));
+  };
+  events.onerror = function() {
+    if (events.readyState == EventSource.CLOSED && !suspendReadings)
+      setTimeout(function() { startReadings(); }, 5000);
+  };
+}
+
 function initPage() {
   getSetup();
   setTimeout(function() { getReadings(); }, 250);
-  setInterval(function() { getReadings(); }, 3000);
+  startReadings();
+  setInterval(function() { tickWebserverTimeout(); }, 1000);
 }
 </script>
 </head>
@@ -252,7 +323,7 @@ function initPage() {
 <span id="sysReset" style="display:none">System wird neu gestartet...</span>
 <span id="timeoutInfo" style="display:none">Webserver-Abschaltung in <span id="WebserverTimeout">--</span></span>
 <span id="webserverOffline" style="display:none">Webserver deaktiviert!</span>
-<span id="calibrateInfo" style="display:none">CO2-Kalibrierung noch <span id="CalibrationTimeout">--</span> Sek.</span>
+<span id="calibrateInfo" style="display:none">CO2-Kalibrierung noch <span id="CalibrationTimeout">--</span> Sek.<span id="calibrationBounds" style="display:none"> (Rauschen &plusmn;<span id="CalibrationSigma">-</span> ppm, Drift <span id="CalibrationDrift">-</span> ppm/min)</span></span>
 <span id="calibrateDone" style="display:none">CO2-Kalibrierung beendet!</span>
 <span id="calibrateFailed" style="display:none">CO2-Kalibrierung fehlgeschlagen!</span>
 <span id="warmupInfo" style="display:none">Aufw&auml;rmphase noch <span id="WarmupTimeout">--</span> Sek.</span>
@@ -265,6 +336,9 @@ function initPage() {
 <table style="min-width:340px">
   <tr><th>Systemzeit:</th><td><span id="Date">--.--.--</span> <span id="Time">--:--</span></td></tr>
   <tr><th>CO2-Konzentration:</th><td><span id="CO2">----</span> ppm</td></tr>
+  <tr><th>CO2-Trend:</th><td><span id="Trend">--</span> ppm/h</td></tr>
+  <tr id="co2_forecast" style="display:none;"><th>N&auml;chste Stufe in:</th><td>~<span id="Forecast">--</span> min</td></tr>
+  <tr id="air_changes" style="display:none;"><th>Luftwechsel:</th><td><span id="ACH">-.-</span> /h</td></tr>
   <tr><th>Temperatur:</th><td><span id="Temp">--</span> &deg;C</td></tr>
   <tr><th>Luftfeuchte:</th><td><span id="Hum">--</span> %</td></tr>
   <tr><th>Luftdruck:</th><td><span id="Pres">----</span> hPa</td></tr>
@@ -272,7 +346,10 @@ function initPage() {
   <tr id="lorawan_addr" style="display:none;"><th>LoRaWAN-Adresse:</th><td><span id="LoRaDevAddr">----------<span></td></tr>
   <tr id="lorawan_seqnoup" style="display:none;"><th>LoRaWAN-Pakete:</th><td><span id="LoRaSeqnoUp">--<span></td></tr>
   <tr id="mqtt_msgs" style="display:none;"><th>MQTT-Nachrichten:</th><td><span id="MqttCounter">--<span></td></tr>
-  <tr><th>Batteriespannung:</th><td id="VBatDisplay"><span id="VBat">-.--</span> V</td></tr>
+  <tr id="wifi_rssi" style="display:none;"><th>WLAN-Signal:</th><td><span id="RSSI">--</span> dBm</td></tr>
+  <tr><th>Batteriespannung:</th><td id="VBatDisplay"><span id="VBat">-.--</span> V<span id="SoC"></span></td></tr>
+  <tr id="battery_life" style="display:none;"><th>Restlaufzeit:</th><td>~<span id="BatteryLife">--</span></td></tr>
+  <tr><th>Startzeit:</th><td><span id="BootTime">-.-</span> Sek.</td></tr>
 </table>
 </div>
 <div id="buttons" style="margin-top:10px">
@@ -495,13 +572,17 @@ function noopSelectors() {
 }
 
 function toggleMedianFilter() {
-  if (document.getElementById("checkbox_medianfilter").checked == true) {
+  if (document.getElementById("co2filter_selector").value == 1) {
     document.getElementById("medianfilter").style.display = "block";
   } else {
     document.getElementById("medianfilter").style.display = "none";
   }
 }
 
+function selectFilter() {
+  document.getElementById("co2filter_selector").value = __CO2FILTER__;
+}
+
 function toggleLogging() {
   if (document.getElementById("checkbox_logging").checked == true) {
     document.getElementById("loginterval").style.display = "block";
@@ -559,7 +640,7 @@ function getSetup() {
 }
 </script>
 </head>
-<body onload="getSetup(); toggleMedianFilter(); toggleAuth(); toggleLogging(); noopSelectors(); selectNoopTime(); configSaved(); configResetted();">
+<body onload="getSetup(); selectFilter(); toggleMedianFilter(); toggleAuth(); toggleLogging(); noopSelectors(); selectNoopTime(); configSaved(); configResetted();">
 <div style="text-align:left;display:inline-block;min-width:340px;">
 <div style="text-align:center;">
 <h2 id="heading">Einstellungen</h2>
@@ -586,9 +667,11 @@ function getSetup() {
   <fieldset><legend><b>&nbsp;Messparameter&nbsp;</b></legend>
   <p><b>Messinterval (min. __INTERVALMIN__ Sek.)</b><br />
   <input name="interval" value="__INTERVAL__" onkeyup="digitsOnly(this)"></p>
+  <p><b>Filter f&uuml;r CO2-Messwerte</b><select id="co2filter_selector" name="co2filter" onchange="toggleMedianFilter();">
+  <option value="0">keiner (Rohwerte)</option><option value="1">Median</option><option value="2">Kalman (geringe Verz&ouml;gerung)</option></select></p>
   <p id="medianfilter"><b>Anzahl Messungen f&uuml;r Medianwert:</b><br />
   <input name="samples" value="__SAMPLES__" onkeyup="digitsOnly(this)"></p>
-  <p><input id="checkbox_medianfilter" name="medianfilter" type="checkbox" onclick="toggleMedianFilter();" __MEDIANFILTER__><b>Medianfilter aktivieren</b></p></fieldset>
+  <p><input id="checkbox_lowpower" name="lowpower" type="checkbox" __LOWPOWER__><b>Stromsparmodus aktivieren (Akku)</b></p></fieldset>
   <br />
   <fieldset><legend><b>&nbsp;Messungen aussetzen&nbsp;</b></legend>
   <p><b>Startzeit</b><br /><span id="noop_start_selector"></span></p>
@@ -801,6 +884,13 @@ function clearSettings() {
     <input id="input_stassid" name="stassid" size="16" maxlength="31" value="__STASSID__"></p>
     <p><b>Passwort (optional)</b><br />
     <input id="input_stapassword" type="password" name="stapassword" size="16" maxlength="31" value="__STAPASSWORD__"></p>
+    <p><b>Weitere WLAN-Netze (optional)</b><br />
+    <input name="stassid1" size="12" maxlength="31" placeholder="SSID" value="__STASSID1__">
+    <input type="password" name="stapassword1" size="12" maxlength="31" placeholder="Passwort" value="__STAPASSWORD1__"><br />
+    <input name="stassid2" size="12" maxlength="31" placeholder="SSID" value="__STASSID2__">
+    <input type="password" name="stapassword2" size="12" maxlength="31" placeholder="Passwort" value="__STAPASSWORD2__"><br />
+    <input name="stassid3" size="12" maxlength="31" placeholder="SSID" value="__STASSID3__">
+    <input type="password" name="stapassword3" size="12" maxlength="31" placeholder="Passwort" value="__STAPASSWORD3__"></p>
   </span></fieldset>
   <span style="display:none" id="mqtt">
     <br />
@@ -0,0 +1,176 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "i2cbus.h"
+#include "logging.h"
+#include "utils.h"
+
+// accounting of transactions wrapped in i2c_begin()/i2c_end(); they
+// are neither scheduled nor coalesced, each module accesses its device
+// directly, only repeated DS3231 reads are saved by rtc_now()
+
+// all devices the firmware knows about; only the SCD30 is required,
+// a missing BME280 or RTC module (DS3231, 24C32 EEPROM) just disables
+// the features depending on them
+static i2cdevice_t devices[I2C_DEVICES] = {
+  { 0x61, "SCD30", true },
+  { 0x76, "BME280", false },
+  { 0x68, "DS3231", false },
+  { 0x57, "24C32", false }
+};
+static uint8_t busRecoveries = 0;
+
+
+// returns true if SDA or SCL are held low while bus should be idle
+static bool i2c_stuck() {
+  pinMode(SDA, INPUT_PULLUP);
+  pinMode(SCL, INPUT_PULLUP);
+  delayMicroseconds(10);
+  return (!digitalRead(SDA) || !digitalRead(SCL));
+}
+
+
+static void i2c_start() {
+  Wire.begin();
+  Wire.setClock(I2C_CLOCK_HZ);
+  Wire.setClockStretchLimit(I2C_CLOCK_STRETCH_US);
+}
+
+
+static bool i2c_probe(uint8_t addr) {
+  Wire.beginTransmission(addr);
+  return (Wire.endTransmission() == 0);
+}
+
+
+// open drain: lines are only pulled low, released lines
+// are pulled high so a slave holding them low wins
+static void i2c_line(uint8_t pin, bool high) {
+  if (high) {
+    pinMode(pin, INPUT_PULLUP);
+  } else {
+    digitalWrite(pin, LOW);
+    pinMode(pin, OUTPUT);
+  }
+}
+
+
+// free a slave holding SDA low (e.g. after a reset during a read)
+// by clocking SCL until SDA is released and sending a STOP condition
+bool i2c_recover() {
+  uint8_t clocks = 0;
+  char buf[32];
+
+  if (!i2c_stuck())
+    return true;
+
+  Serial.print(F("I2C: bus stuck, recovering..."));
+  i2c_line(SDA, true);
+  while (!digitalRead(SDA) && clocks++ < I2C_RECOVERY_CLOCKS) {
+    i2c_line(SCL, false);
+    delayMicroseconds(5);
+    i2c_line(SCL, true);
+    delayMicroseconds(5);
+  }
+  i2c_line(SDA, false);
+  delayMicroseconds(5);
+  i2c_line(SCL, true);
+  delayMicroseconds(5);
+  i2c_line(SDA, true);
+  delayMicroseconds(5);
+
+  busRecoveries++;
+  if (i2c_stuck()) {
+    Serial.println(F("failed!"));
+    logMsg("i2c bus recovery failed");
+    i2c_start();
+    return false;
+  }
+  i2c_start();
+  Serial.printf("OK (%d clocks).\n", clocks);
+  sprintf(buf, "i2c bus recovered, %d clocks", clocks);
+  logMsg(buf);
+  return true;
+}
+
+
+// start I2C bus and probe for all expected devices,
+// returns false if a required device is missing
+bool i2c_init() {
+  bool ok = true;
+  char buf[32];
+
+  i2c_recover();
+  i2c_start();
+  Serial.println(F("Probing I2C bus..."));
+  for (uint8_t i = 0; i < I2C_DEVICES; i++) {
+    devices[i].present = i2c_probe(devices[i].addr);
+    // retry required devices which might not be up yet
+    while (!devices[i].present && devices[i].required && millis() < I2C_POWERUP_MS) {
+      delay(50);
+      devices[i].present = i2c_probe(devices[i].addr);
+    }
+    Serial.printf("%s (0x%02X): %s\n", devices[i].name, devices[i].addr,
+      devices[i].present ? "found" : (devices[i].required ? "missing" : "missing, disabled"));
+    if (!devices[i].present) {
+      sprintf(buf, "i2c %s missing", devices[i].name);
+      logMsg(lowercase(buf));
+      if (devices[i].required)
+        ok = false;
+    }
+  }
+  return ok;
+}
+
+
+bool i2c_present(i2cDevices dev) {
+  return devices[dev].present;
+}
+
+
+// mark start of a transaction with given device
+uint32_t i2c_begin(i2cDevices dev) {
+  devices[dev].transactions++;
+  return micros();
+}
+
+
+// account latency and errors of a transaction started with i2c_begin();
+// tries to recover the bus if a failure leaves it in a stuck state
+bool i2c_end(i2cDevices dev, uint32_t startMicros, bool success) {
+  uint32_t latency = micros() - startMicros;
+
+  devices[dev].latencySum += latency;
+  if (latency > devices[dev].latencyMax)
+    devices[dev].latencyMax = latency;
+
+  if (!success) {
+    devices[dev].nacks++;
+    if (i2c_stuck())
+      i2c_recover();
+    else
+      i2c_start(); // i2c_stuck() has reset pin modes
+  }
+  return success;
+}
+
+
+// print transaction counters and latencies for all devices
+void i2c_stats() {
+  Serial.printf("I2C bus statistics (%d recoveries):\n", busRecoveries);
+  for (uint8_t i = 0; i < I2C_DEVICES; i++) {
+    if (!devices[i].present)
+      continue;
+    Serial.printf("%s: %d transactions, %d errors, latency avg %dus max %dus\n",
+      devices[i].name, devices[i].transactions, devices[i].nacks,
+      devices[i].transactions ? devices[i].latencySum / devices[i].transactions : 0,
+      devices[i].latencyMax);
+  }
+}
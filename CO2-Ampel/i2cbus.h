@@ -0,0 +1,50 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _I2CBUS_H
+#define _I2CBUS_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define I2C_CLOCK_HZ 100000  // see SCD30_Interface_Description.pdf (May 2020)
+#define I2C_CLOCK_STRETCH_US 30000
+#define I2C_RECOVERY_CLOCKS 9
+#define I2C_STATS_SECS 3600
+#define I2C_POWERUP_MS 2000  // SCD30 needs up to 2 secs after power-up
+
+// expected devices, see table in i2cbus.cpp
+enum i2cDevices {
+  I2C_SCD30,
+  I2C_BME280,
+  I2C_DS3231,
+  I2C_EEPROM,
+  I2C_DEVICES
+};
+
+typedef struct {
+  uint8_t addr;
+  const char* name;
+  bool required;
+  bool present;
+  uint32_t transactions;
+  uint32_t nacks;
+  uint32_t latencySum;  // usecs
+  uint32_t latencyMax;  // usecs
+} i2cdevice_t;
+
+bool i2c_init();
+bool i2c_present(i2cDevices dev);
+uint32_t i2c_begin(i2cDevices dev);
+bool i2c_end(i2cDevices dev, uint32_t startMicros, bool success);
+bool i2c_recover();
+void i2c_stats();
+
+#endif
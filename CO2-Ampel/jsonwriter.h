@@ -0,0 +1,195 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _JSONWRITER_H
+#define _JSONWRITER_H
+
+#include <Arduino.h>
+#include "format.h"
+
+// JSON objects with a schema fixed at compile time: an object is a
+// list of fields, each a key and a value type with a known maximum
+// length; values are written in a single pass straight into the
+// output buffer, which is checked at compile time to be large enough
+//
+//   JSON_KEY(co2median);
+//   typedef json::Object<json::Field<co2median, json::UInt16>> schema;
+//   char buf[schema::size];
+//   schema::write(buf, scd30_co2ppm);
+
+// declares a key type named like the key itself
+#define JSON_KEY(name) struct name { \
+  static const char* str() { return #name; } \
+  enum { len = sizeof(#name) - 1 }; \
+}
+
+namespace json {
+
+// value of an optional field, omitted if not present
+template<typename T>
+struct Maybe {
+  T value;
+  bool present;
+  Maybe(T v, bool p) : value(v), present(p) {}
+  template<typename U>
+  Maybe(const Maybe<U> &m) : value(m.value), present(m.present) {}
+};
+
+template<typename T>
+Maybe<T> maybe(T value, bool present) {
+  return Maybe<T>(value, present);
+}
+
+
+// value types, write() returns pointer past the last char written
+struct UInt8 {
+  typedef uint8_t type;
+  enum { maxLen = 3 };
+  static char* write(char *p, type v) { return fmt_uint(p, v); }
+};
+
+struct UInt16 {
+  typedef uint16_t type;
+  enum { maxLen = 5 };
+  static char* write(char *p, type v) { return fmt_uint(p, v); }
+};
+
+struct Int16 {
+  typedef int16_t type;
+  enum { maxLen = 6 };
+  static char* write(char *p, type v) { return fmt_int(p, v); }
+};
+
+struct UInt32 {
+  typedef uint32_t type;
+  enum { maxLen = 10 };
+  static char* write(char *p, type v) { return fmt_uint(p, v); }
+};
+
+struct Int32 {
+  typedef int32_t type;
+  enum { maxLen = 11 };
+  static char* write(char *p, type v) { return fmt_int(p, v); }
+};
+
+// int16_t in 10^-Scale units (e.g. centi-°C) with given decimals
+template<uint8_t Scale, uint8_t Decimals>
+struct Fixed {
+  typedef int16_t type;
+  enum { maxLen = 7 + (Decimals > Scale ? Decimals - Scale : 0) };
+  static char* write(char *p, type v) { return fmt_fixed(p, v, Scale, Decimals); }
+};
+
+// string with up to N chars, quotes and backslashes are escaped,
+// control chars (e.g. in SSIDs) as \u00XX
+template<size_t N>
+struct Str {
+  typedef const char* type;
+  enum { maxLen = 6 * N + 2 };
+  static char* write(char *p, type v) {
+    *p++ = '"';
+    for (size_t i = 0; i < N && v[i]; i++) {
+      if (uint8_t(v[i]) < 0x20) {
+        memcpy(p, "\\u00", 4);
+        p[4] = '0' + (v[i] >> 4);
+        p[5] = "0123456789abcdef"[v[i] & 0x0F];
+        p += 6;
+        continue;
+      }
+      if (v[i] == '"' || v[i] == '\\')
+        *p++ = '\\';
+      *p++ = v[i];
+    }
+    *p++ = '"';
+    return p;
+  }
+};
+
+// preformatted JSON value with up to N chars
+template<size_t N>
+struct Raw {
+  typedef const char* type;
+  enum { maxLen = N };
+  static char* write(char *p, type v) {
+    for (size_t i = 0; i < N && v[i]; i++)
+      *p++ = v[i];
+    return p;
+  }
+};
+
+
+// "key":value
+template<typename Key, typename T>
+struct Field {
+  typedef typename T::type type;
+  enum { maxLen = Key::len + 3 + T::maxLen };
+  static char* write(char *p, bool &first, const type &v) {
+    if (!first)
+      *p++ = ',';
+    first = false;
+    *p++ = '"';
+    memcpy(p, Key::str(), Key::len);
+    p += Key::len;
+    *p++ = '"';
+    *p++ = ':';
+    return T::write(p, v);
+  }
+};
+
+// field which might be omitted at runtime, value is passed as json::maybe()
+template<typename Key, typename T>
+struct Optional {
+  typedef Maybe<typename T::type> type;
+  enum { maxLen = Field<Key, T>::maxLen };
+  static char* write(char *p, bool &first, const type &v) {
+    return v.present ? Field<Key, T>::write(p, first, v.value) : p;
+  }
+};
+
+
+template<size_t... N> struct Sum;
+template<> struct Sum<> { enum { value = 0 }; };
+template<size_t N, size_t... R> struct Sum<N, R...> { enum { value = N + Sum<R...>::value }; };
+
+template<typename... Fields>
+struct Object {
+  // braces, commas between fields, all fields and terminating null
+  enum { size = 2 + sizeof...(Fields) - 1 + Sum<Fields::maxLen...>::value + 1 };
+
+  // values are passed in order of fields, returns length of JSON string
+  template<size_t N>
+  static size_t write(char (&buf)[N], const typename Fields::type&... values) {
+    static_assert(N >= size, "JSON buffer too small for schema");
+    bool first = true;
+    char *p = buf;
+
+    *p++ = '{';
+    p = writeFields<Fields...>(p, first, values...);
+    *p++ = '}';
+    *p = '\0';
+    return p - buf;
+  }
+
+ private:
+  template<typename F>
+  static char* writeFields(char *p, bool &first, const typename F::type &v) {
+    return F::write(p, first, v);
+  }
+
+  template<typename F, typename G, typename... R>
+  static char* writeFields(char *p, bool &first, const typename F::type &v,
+      const typename G::type &w, const typename R::type&... rest) {
+    return writeFields<G, R...>(F::write(p, first, v), first, w, rest...);
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,91 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "kalman.h"
+
+// CO2 level and its rate of change estimated by a Kalman filter with
+// a constant rate model (white noise acceleration); a steady rise is
+// tracked without lag, unlike a median which trails by half its
+// window; readings far off the prediction are skipped as spikes, but
+// several of them in a row are taken as a real step and restart it;
+// kept in float since the rate variance shrinks by about five decades
+// after a restart, an update costs some 30 soft float operations once
+// per reading interval (at least 5 secs)
+static float level, rate;  // ppm, ppm/s
+static float p00, p01, p11;  // covariance
+static uint32_t lastSample;
+static uint8_t outliers;
+static bool valid = false;
+
+
+// start from given reading with unknown rate
+static void kalman_init(uint16_t co2ppm, uint32_t now) {
+  level = co2ppm;
+  rate = 0;
+  p00 = sq(float(KALMAN_NOISE_PPM));
+  p01 = 0;
+  p11 = sq(KALMAN_RATE_MAX_PPMS);
+  lastSample = now;
+  outliers = 0;
+  valid = true;
+}
+
+
+void kalman_add(uint16_t co2ppm) {
+  uint32_t now = millis()/1000;
+  float dt, q, s, k0, k1, resid;
+
+  if (!valid) {
+    kalman_init(co2ppm, now);
+    return;
+  }
+
+  // predict
+  dt = (now > lastSample) ? now - lastSample : 1;
+  lastSample = now;
+  q = sq(float(KALMAN_ACCEL));
+  level += rate * dt;
+  p00 += dt * (2 * p01 + dt * p11) + q * dt * dt * dt / 3;
+  p01 += dt * p11 + q * dt * dt / 2;
+  p11 += q * dt;
+
+  // gate on normalized residual, prediction stays as estimate
+  resid = co2ppm - level;
+  s = p00 + sq(float(KALMAN_NOISE_PPM));
+  if (sq(resid) > sq(float(KALMAN_GATE)) * s) {
+    if (++outliers >= KALMAN_GATE_MAX)
+      kalman_init(co2ppm, now);
+    return;
+  }
+  outliers = 0;
+
+  // update
+  k0 = p00 / s;
+  k1 = p01 / s;
+  level += k0 * resid;
+  rate += k1 * resid;
+  p11 -= k1 * p01;
+  p01 -= k0 * p01;
+  p00 -= k0 * p00;
+}
+
+
+// start over (e.g. after calibration)
+void kalman_reset() {
+  valid = false;
+}
+
+
+// current estimate, 0 if there were no readings yet
+uint16_t kalman_ppm() {
+  if (!valid)
+    return 0;
+  return constrain(lroundf(level), 0L, 65535L);
+}
@@ -0,0 +1,29 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _KALMAN_H
+#define _KALMAN_H
+
+#include <Arduino.h>
+
+#define KALMAN_NOISE_PPM 10  // SCD30 measurement noise (1 sigma)
+#define KALMAN_ACCEL 0.001  // process noise, change of rate in ppm/s per sqrt(s)
+#define KALMAN_GATE 4  // readings off by more than 4 sigma are outliers
+#define KALMAN_GATE_MAX 3  // restart on 3rd outlier in a row (step change)
+// initial rate uncertainty (1 sigma), about the fastest rise of an occupied
+// room; larger values let a spike right after a restart pass the gate at
+// the 60 secs interval of low power mode
+#define KALMAN_RATE_MAX_PPMS 1.0
+
+void kalman_add(uint16_t co2ppm);
+void kalman_reset();
+uint16_t kalman_ppm();
+
+#endif
@@ -11,9 +11,12 @@
 #include "logging.h"
 #include "webserver.h"
 #include "sensors.h"
+#include "snapshot.h"
 #include "utils.h"
+#include "format.h"
 #include "rtc.h"
 #include "config.h"
+#include "resume.h"
 
 #ifdef LANG_EN
 #include "html_EN.h"
@@ -23,6 +26,54 @@
 
 static bool fsInited = true;
 
+// statistics of one quantity within a rollup period
+typedef struct {
+  int32_t min, max, sum;
+  int64_t twSum;  // value * secs
+} rollstat_t;
+
+// co2, temperature, humidity and pressure of one hour or day
+typedef struct {
+  uint32_t start;  // local time
+  uint32_t secs;
+  uint16_t count;
+  rollstat_t stats[4];
+} rollup_t;
+
+static rollup_t rollups[2];  // hourly, daily
+static uint32_t lastRollupSample = 0;
+
+// restore pending rollups saved before deep sleep or restart
+static void loadRollups() {
+  File file = LittleFS.open(ROLLUP_STATE_NAME, "r");
+
+  if (!file)
+    return;
+  if (file.size() == sizeof(rollups) + sizeof(lastRollupSample)) {
+    file.read((uint8_t *) rollups, sizeof(rollups));
+    file.read((uint8_t *) &lastRollupSample, sizeof(lastRollupSample));
+    Serial.println(F("Pending rollups restored."));
+  }
+  file.close();
+  LittleFS.remove(ROLLUP_STATE_NAME);
+}
+
+
+// save pending rollups, they would be lost otherwise
+void saveRollups() {
+  File file;
+
+  if (!settings.enableLogging || !fsInited)
+    return;
+  file = LittleFS.open(ROLLUP_STATE_NAME, "w");
+  if (file) {
+    file.write((uint8_t *) rollups, sizeof(rollups));
+    file.write((uint8_t *) &lastRollupSample, sizeof(lastRollupSample));
+    file.close();
+  }
+}
+
+
 void mountFS() {
   FSInfo fs_info;
   uint32_t freeBytes;
@@ -33,9 +84,12 @@ void mountFS() {
     Serial.print(F("LittleFS mounted: "));
     Serial.print(freeBytes/1024);
     Serial.println(F(" kb free"));
-    listDirectory("/");
-    rotateLogs();
+    if (!resumed) {  // already done before deep sleep
+      listDirectory("/");
+      rotateLogs();
+    }
     fsInited = true;
+    loadRollups();
   } else {
     Serial.println(F("Failed to mount LittleFS!"));
   }
@@ -44,18 +98,12 @@ void mountFS() {
 
 void logMsg(char *msg) {
   File logfile;
-  uint32_t epoch = 0;
   char timeStr[20];
-  DateTime now;
   
   if (!settings.enableLogging || !fsInited)
     return;
 
-  if (rtcOK) {
-    now = rtc.now();
-    epoch = now.unixtime();
-  }
-  time_t t = CE.toLocal(epoch);
+  time_t t = rtc_local();
   logfile = LittleFS.open(LOGFILE_NAME, "a");
   if (logfile) {
     sprintf(timeStr, "%4d-%.2d-%.2dT%.2d:%.2d:%.2d", 
@@ -68,36 +116,107 @@ void logMsg(char *msg) {
 }
 
 
+// append record with count, min, max, mean and time-weighted mean of
+// each quantity to rollup file, temperature in °C with two decimals
+static void writeRollup(const char* filename, rollup_t *r) {
+  char line[160];
+  char *p;
+  int32_t v[4];
+  File file;
+
+  if (!r->count)
+    return;
+
+  if (!LittleFS.exists(filename)) {
+    file = LittleFS.open(filename, "w");
+    if (file) {
+      file.println(F("start,count,co2Min,co2Max,co2Mean,co2TwMean,tempMin,tempMax,tempMean,tempTwMean,"
+        "humMin,humMax,humMean,humTwMean,presMin,presMax,presMean,presTwMean"));
+      file.close();
+    }
+  }
+
+  p = line + sprintf(line, "%4d-%.2d-%.2dT%.2d:00,%u", year(r->start), month(r->start),
+    day(r->start), hour(r->start), r->count);
+  for (uint8_t i = 0; i < 4; i++) {
+    v[0] = r->stats[i].min;
+    v[1] = r->stats[i].max;
+    v[2] = r->stats[i].sum / r->count;
+    v[3] = r->secs ? r->stats[i].twSum / r->secs : v[2];
+    for (uint8_t k = 0; k < 4; k++) {
+      p = fmt_char(p, ',');
+      p = (i == 1) ? fmt_fixed(p, v[k], 2, 2) : fmt_int(p, v[k]);
+    }
+  }
+  *p = '\0';
+
+  file = LittleFS.open(filename, "a");
+  if (file) {
+    file.println(line);
+    file.close();
+  }
+}
+
+
+// update hourly and daily rollups with current readings, a record
+// is written when a new hour or day begins; each reading is weighted
+// with the time since the previous one for the time-weighted mean
+static void rollupReadings() {
+  const char* filenames[2] = { ROLLUP_HOURLY_NAME, ROLLUP_DAILY_NAME };
+  const uint32_t periods[2] = { 3600, 86400 };
+  int32_t values[4] = { scd30_co2ppm, bme280_temperature,
+    hasBME280 ? bme280_humidity : scd30_humidity, bme280_pressure };
+  uint32_t t = rtc_local(), dt = 0;
+  rollstat_t *s;
+
+  if (!t)
+    return;
+  if (lastRollupSample && t > lastRollupSample && t - lastRollupSample <= ROLLUP_MAX_GAP_SECS)
+    dt = t - lastRollupSample;
+  lastRollupSample = t;
+
+  for (uint8_t r = 0; r < 2; r++) {
+    if (rollups[r].start != t - t % periods[r]) {
+      writeRollup(filenames[r], &rollups[r]);
+      memset(&rollups[r], 0, sizeof(rollup_t));
+      rollups[r].start = t - t % periods[r];
+    }
+    for (uint8_t i = 0; i < 4; i++) {
+      s = &rollups[r].stats[i];
+      if (!rollups[r].count || values[i] < s->min)
+        s->min = values[i];
+      if (!rollups[r].count || values[i] > s->max)
+        s->max = values[i];
+      s->sum += values[i];
+      s->twSum += int64_t(values[i]) * dt;
+    }
+    rollups[r].secs += dt;
+    rollups[r].count++;
+  }
+}
+
+
 void logReadings(uint32_t runtimeSecs) {
-  static char csv[64], buf[16];
+  static char csv[64];
+  char *p;
 
   if (co2status == NOOP || !settings.enableLogging)
     return;
 
-  sprintf(csv, "%d,%s,", runtimeSecs, statusNames[co2status]);
-  itoa(scd30_co2ppm, buf, 10);
-  strcat(csv, buf);
-  strcat(csv, ",");
-  dtostrf(scd30_temperature, 6, 2, buf);
-  strcat(csv, buf);
-  strcat(csv, ",");
-  itoa(scd30_humidity, buf, 10);
-  strcat(csv, buf);
-  strcat(csv, ",");
-  dtostrf(bme280_temperature, 6, 2, buf);
-  strcat(csv, buf);
-  strcat(csv, ",");
-  itoa(bme280_humidity, buf, 10);
-  strcat(csv, buf);
-  strcat(csv, ",");
-  itoa(bme280_pressure, buf, 10);
-  strcat(csv, buf);
-  strcat(csv, ","); 
-  dtostrf(getVBAT(), 5, 2, buf);
-  strcat(csv, buf);
-  
-  logMsg(removeSpaces(csv));
+  p = csv + sprintf(csv, "%d,%s,", runtimeSecs, statusNames[co2status]);
+  p = fmt_char(fmt_uint(p, scd30_co2ppm), ',');
+  p = fmt_char(fmt_fixed(p, scd30_temperature, 2, 2), ',');
+  p = fmt_char(fmt_uint(p, scd30_humidity), ',');
+  p = fmt_char(fmt_fixed(p, bme280_temperature, 2, 2), ',');
+  p = fmt_char(fmt_uint(p, bme280_humidity), ',');
+  p = fmt_char(fmt_uint(p, bme280_pressure), ',');
+  fmt_fixed(p, snapshot.vbat, 3, 2);
+
+  logMsg(csv);
   Serial.println(F("Readings logged."));
+
+  if (co2status >= GOOD && co2status <= ALARM)
+    rollupReadings();
 }
 
 
@@ -105,7 +224,8 @@ bool handleSendFile(String path) {
   if (!settings.enableLogging || !fsInited)
     return false;
 
-  if (LittleFS.exists(path) && strstr(path.c_str(), LOGFILE_NAME) != NULL) {
+  if (LittleFS.exists(path) && (strstr(path.c_str(), LOGFILE_NAME) != NULL ||
+      strstr(path.c_str(), ROLLUP_HOURLY_NAME) != NULL || strstr(path.c_str(), ROLLUP_DAILY_NAME) != NULL)) {
     File file = LittleFS.open(path, "r");
     if (file) {
       logMsg("send log");
@@ -179,6 +299,20 @@ void removeLogs() {
   }
 }
 
+// keep one older generation of a rollup file
+static void rotateRollup(const char* filename) {
+  String fOld = String(filename) + ".1";
+  File file = LittleFS.open(filename, "r");
+
+  if (file && file.size() > ROLLUP_MAX_SIZE) {
+    file.close();
+    LittleFS.remove(fOld);
+    Serial.print(filename); Serial.print(" -> "); Serial.println(fOld);
+    LittleFS.rename(filename, fOld);
+  }
+}
+
+
 void rotateLogs() {
   String fOld, fNew;
   int maxFiles = 0;
@@ -208,6 +342,10 @@ void rotateLogs() {
     Serial.print(fOld); Serial.print(" -> "); Serial.println(fNew);
     LittleFS.rename(fOld, fNew);
   }
+
+  // rollups are kept independently of raw logs
+  rotateRollup(ROLLUP_HOURLY_NAME);
+  rotateRollup(ROLLUP_DAILY_NAME);
 }
 
 
@@ -18,6 +18,11 @@
 #define LOGFILE_MAX_SIZE 1024*50  // 50k
 #define LOGFILE_MAX_FILES 24
 #define LOGFILE_NAME "/sensor.log"
+#define ROLLUP_HOURLY_NAME "/rollup_hourly.csv"
+#define ROLLUP_DAILY_NAME "/rollup_daily.csv"
+#define ROLLUP_STATE_NAME "/rollup.state"
+#define ROLLUP_MAX_SIZE 1024*100  // ~1 month hourly, older records are moved to *.1
+#define ROLLUP_MAX_GAP_SECS 900  // longer gaps are not time-weighted
 
 void mountFS();
 void logMsg(char *msg);
@@ -26,6 +31,7 @@ void sendAllLogs();
 void rotateLogs();
 void removeLogs();
 void logReadings(uint32_t runtimeSecs);
+void saveRollups();
 bool handleSendFile(String path);
 String listDirHTML(const char* path);
 
@@ -11,6 +11,7 @@
 #include "lorawan.h"
 #include "led.h"
 #include "sensors.h"
+#include "snapshot.h"
 #include "rtc.h"
 #include "logging.h"
 #include "utils.h"
@@ -352,7 +353,7 @@ void onEvent (ev_t event) {
 // send off payload with sensor data
 void lmic_send(osjob_t* job) {
   uint8_t i = 1;
-  uint8_t payload[15];
+  uint8_t payload[25];
   uint16_t temp;
 
   if (!lorawanSettings.enabled)
@@ -365,29 +366,49 @@ void lmic_send(osjob_t* job) {
   } else {
     // prepare payload for uplink transmission
     payload[i++] = 0x01;
-    payload[i++] = byte(co2status & 0xff);
+    payload[i++] = byte(snapshot.status & 0xff);
 
     payload[i++] = 0x10;
-    temp = int(bme280_temperature * 10);
+    temp = snapshot.temperature / 10;
     payload[i++] = byte(temp >> 8);
     payload[i++] = byte(temp & 0xff);
 
     // 0-100%
     payload[i++] = 0x11;
-    payload[i++] = byte(int(bme280_humidity) & 0xff);
+    payload[i++] = byte(int(snapshot.humidity) & 0xff);
 
     // range from low 870hPa to high 1085hPa fit's into single byte value
     payload[i++] = 0x12;
-    payload[i++] = byte((bme280_pressure / 100 - 870) & 0xff);
+    payload[i++] = byte((snapshot.pressure / 100 - 870) & 0xff);
 
     // SCD30 value range from 0 to 40000ppm
     payload[i++] = 0x13;
-    payload[i++] = byte(scd30_co2ppm >> 8);
-    payload[i++] = byte(scd30_co2ppm & 0xff);
+    payload[i++] = byte(snapshot.co2ppm >> 8);
+    payload[i++] = byte(snapshot.co2ppm & 0xff);
+
+    // CO2 trend in ppm/h (signed) and minutes until next threshold
+    payload[i++] = 0x14;
+    payload[i++] = byte(uint16_t(snapshot.trend) >> 8);
+    payload[i++] = byte(snapshot.trend & 0xff);
+    if (snapshot.forecast >= 0) {
+      payload[i++] = 0x15;
+      payload[i++] = byte(snapshot.forecast);  // max. TREND_FORECAST_MAX_MINS
+    }
 
     // battery voltage
     payload[i++] = 0x20;
-    payload[i++] = int(getVBAT()*100) - 256;
+    payload[i++] = snapshot.vbat / 10 - 256;
+
+    // battery state of charge (0-100%) and remaining runtime (hours)
+    if (snapshot.vbat > VBAT_CONNECTED_MV) {
+      payload[i++] = 0x21;
+      payload[i++] = snapshot.soc;
+      if (snapshot.runtime >= 0) {
+        payload[i++] = 0x22;
+        payload[i++] = byte(snapshot.runtime >> 8);
+        payload[i++] = byte(snapshot.runtime & 0xff);
+      }
+    }
 
     // payload size serves as simple check sum
     payload[0] = i;
@@ -418,6 +439,12 @@ bool lmic_ready() {
 }
 
 
+// returns true while a transmission is pending
+bool lmic_busy() {
+  return lmicInited && (LMIC.opmode & OP_TXRXPEND);
+}
+
+
 // wait for pending LoRaWAN jobs for given number of seconds
 // optionaly toggle LED while waiting
 void waitForLorawanJobs(uint8_t secs, bool toggleLED) {
@@ -442,7 +469,7 @@ void waitForLorawanJobs(uint8_t secs, bool toggleLED) {
 
 // remap LiIon battery voltage (3.45 - 4.2V) to 1-254
 uint8_t os_getBattLevel(void) {
-  return (uint8_t) map(getVBAT() * 1000, 3450, 4200, MCMD_DEVS_BATT_MIN, MCMD_DEVS_BATT_MAX);
+  return (uint8_t) map(snapshot.soc, 0, 100, MCMD_DEVS_BATT_MIN, MCMD_DEVS_BATT_MAX);
 }
 
 
@@ -453,7 +480,7 @@ void loadLoRaWANSession() {
 
   Serial.printf("Loading LoRaWAN session data (%d bytes) from EEPROM...", sizeof(lorawanSession));
   memset(&buf, 0, sizeof(buf));
-  if (!rtceeprom.eeprom_read(EEPROM_LORAWAN_SESSION_ADDR, (byte *) &buf, sizeof(buf))) {
+  if (!i2c_present(I2C_EEPROM) || !rtceeprom.eeprom_read(EEPROM_LORAWAN_SESSION_ADDR, (byte *) &buf, sizeof(buf))) {
     logMsg("load lorawan session failed");
     Serial.println(F("failed!"));
     error = true;
@@ -75,6 +75,7 @@ void lmic_init();
 void lmic_stop();
 void lmic_send(osjob_t* job);
 bool lmic_ready();
+bool lmic_busy();
 void waitForLorawanJobs(uint8_t secs, bool toogleLED);
 void loadLoRaWANSession();
 bool saveLoRaWANSession();
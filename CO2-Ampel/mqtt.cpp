@@ -11,7 +11,10 @@
 #include "mqtt.h"
 #include "wifi.h"
 #include "utils.h"
+#include "format.h"
 #include "sensors.h"
+#include "snapshot.h"
+#include "exposure.h"
 #include "logging.h"
 #include "rtc.h"
 #include "led.h"
@@ -20,12 +23,49 @@
 mqttprefs_t mqttSettings;
 
 static char clientname[64];
+static char willTopic[96];
 static bool mqttInited = false;
 static uint16_t mqttMessageCount = 0;
+static uint32_t mqttConnectMillis = 0;
+
+// ring buffer of JSON readings, the first queueInFlight entries
+// have been published and are dropped if the connection is still
+// up one loop later; best effort only, a QoS 0 publish may still
+// sit in the TCP send buffer when the connection is lost
+static char mqttQueue[MQTT_QUEUE_SIZE][snapshotJSON::size];
+static uint8_t queueHead = 0, queueLen = 0, queueInFlight = 0;
 
 WiFiClient wifi;
 PubSubClient mqtt(wifi);
 
+#ifdef MQTT_HA_DISCOVERY
+#define HA_ALWAYS 0
+#define HA_BME280 1
+#define HA_BATTERY 2
+
+// Home Assistant sensors for subtopics published by mqttSingle()
+typedef struct {
+  char key[12];
+  char name[16];
+  char deviceClass[16];
+  char unit[8];
+  uint8_t requires;
+} hasensor_t;
+
+static const hasensor_t haSensors[] PROGMEM = {
+  { "co2median", "CO2", "carbon_dioxide", "ppm", HA_ALWAYS },
+  { "temperature", "Temperature", "temperature", "\u00b0C", HA_ALWAYS },
+  { "pressure", "Pressure", "pressure", "hPa", HA_ALWAYS },
+  { "hum", "Humidity", "humidity", "%", HA_BME280 },
+  { "vbat", "Battery voltage", "voltage", "V", HA_ALWAYS },
+  { "soc", "Battery", "battery", "%", HA_BATTERY },
+  { "runtime", "Battery runtime", "duration", "h", HA_BATTERY },
+  { "trend", "CO2 trend", "", "ppm/h", HA_ALWAYS },
+  { "forecast", "Next CO2 level", "duration", "min", HA_ALWAYS },
+  { "status", "Status", "", "", HA_ALWAYS }
+};
+#endif
+
 
 // load defaults settings from config.h
 static void setDefaults(mqttprefs_t *s) {
@@ -71,27 +111,151 @@ static bool printMQTTSettings(mqttprefs_t *s) {
 }
 
 
-// send sensor data as JSON
-static bool mqttJSON() {
-  StaticJsonDocument<128> JSON;
-  char buf[128];
-
-  JSON["device"] = systemID();
-  if (co2status > WARMUP && co2status <= ALARM) {
-    JSON["co2median"] = scd30_co2ppm;
-    JSON["temperature"] = bme280_temperature;
-    if (hasBME280)
-      JSON["humidity"] = bme280_humidity;
-    JSON["pressure"] = bme280_pressure;
+static void mqtt_enqueue(const char* json) {
+  if (queueLen == MQTT_QUEUE_SIZE) {  // drop oldest reading
+    queueHead = (queueHead + 1) % MQTT_QUEUE_SIZE;
+    queueLen--;
+    if (queueInFlight)
+      queueInFlight--;
+    logMsg("mqtt queue overflow");
+  }
+  strncpy(mqttQueue[(queueHead + queueLen) % MQTT_QUEUE_SIZE], json, sizeof(mqttQueue[0])-1);
+  queueLen++;
+}
+
+
+// publish all queued readings not yet in flight
+static bool mqtt_flush() {
+  while (queueInFlight < queueLen) {
+    if (!mqtt.publish(mqttSettings.topic, mqttQueue[(queueHead + queueInFlight) % MQTT_QUEUE_SIZE]))
+      return false;
+    queueInFlight++;
+    delay(MQTT_PUSH_DELAY_MS);
   }
-  JSON["co2status"] = statusNames[co2status];
-  JSON["vbat"] = ((int)(getVBAT()*100)) / 100.0;
+  return true;
+}
+
+
+static bool mqtt_status() {
+  char topicStr[96];
+
+  sprintf(topicStr, "%s/%s/status", mqttSettings.topic, systemID().c_str());
+  return mqtt.publish(topicStr, statusNames[snapshot.status], true);
+}
+
+
+// publish retained exposure of current and last hour, day and
+// week once per hour to <topic>/<id>/exposure/<window>
+static void mqtt_exposure() {
+  static uint32_t publishedHour = 0;
+  char topicStr[128], json[exposureJSON::size];
+  uint8_t w, last, count = 0;
+
+  if (!exposure_hour() || exposure_hour() == publishedHour)
+    return;
+  for (w = EXPOSURE_HOUR; w <= EXPOSURE_WEEK; w++) {
+    for (last = 0; last <= 1; last++) {
+      exposure_json(exposureWindow(w), last, json);
+      sprintf(topicStr, "%s/%s/exposure/%s", mqttSettings.topic, systemID().c_str(),
+        exposure_name(exposureWindow(w), last));
+      if (mqtt.publish(topicStr, json, true))
+        count++;
+      delay(MQTT_PUSH_DELAY_MS);
+    }
+  }
+  if (count == 6)
+    publishedHour = exposure_hour();
+  else
+    logMsg("mqtt exposure failed");
+}
+
+
+#ifdef MQTT_HA_DISCOVERY
+// publish retained discovery config for each sensor in table,
+// device is bound to availability topic of last will
+static void mqtt_discovery() {
+  static char payload[MQTT_BUFFER_SIZE];
+  char topicStr[128], device[32], id[48];
+  hasensor_t s;
+  uint8_t count = 0;
+  // 8 fields, device object with 4 fields and ids array; strings from
+  // char arrays are copied into the document (device twice), literals not
+  StaticJsonDocument<JSON_OBJECT_SIZE(8) + JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(1) +
+    sizeof(s.name) + sizeof(s.deviceClass) + sizeof(s.unit) + sizeof(id) +
+    sizeof(topicStr) + sizeof(willTopic) + 2 * sizeof(device)> JSON;
+
+  sprintf(device, "%s-%s", MQTT_CLIENT_NAME, systemID().c_str());
+  for (uint8_t i = 0; i < sizeof(haSensors)/sizeof(hasensor_t); i++) {
+    memcpy_P(&s, &haSensors[i], sizeof(s));
+    if ((s.requires == HA_BME280 && !hasBME280) || (s.requires == HA_BATTERY && snapshot.vbat <= VBAT_CONNECTED_MV))
+      continue;
+
+    JSON.clear();
+    sprintf(id, "%s-%s", device, s.key);
+    snprintf(topicStr, sizeof(topicStr), "%s/%s/%s", mqttSettings.topic, systemID().c_str(), s.key);
+    JSON["name"] = s.name;
+    JSON["uniq_id"] = id;
+    JSON["stat_t"] = topicStr;
+    JSON["avty_t"] = willTopic;
+    if (strlen(s.deviceClass))
+      JSON["dev_cla"] = s.deviceClass;
+    if (strlen(s.unit)) {
+      JSON["unit_of_meas"] = s.unit;
+      JSON["stat_cla"] = "measurement";
+    }
+    JSON["dev"]["ids"][0] = device;
+    JSON["dev"]["name"] = device;
+    JSON["dev"]["mdl"] = "CO2-Ampel";
+    JSON["dev"]["sw"] = FIRMWARE_VERSION;
+    // don't announce a truncated config
+    if (JSON.overflowed() || measureJson(JSON) >= sizeof(payload)) {
+      Serial.printf("MQTT: discovery config for %s too large!\n", s.key);
+      logMsg("mqtt discovery overflow");
+      continue;
+    }
+    serializeJson(JSON, payload, sizeof(payload));
+
+    sprintf(topicStr, "%s/sensor/%s/%s/config", MQTT_HA_DISCOVERY, device, s.key);
+    if (mqtt.publish(topicStr, payload, true))
+      count++;
+    delay(MQTT_PUSH_DELAY_MS);
+  }
+  Serial.printf("MQTT: published %d Home Assistant discovery configs.\n", count);
+}
+#endif
+
+
+// connect with stable client ID and last will, announce
+// device as online and publish retained status
+static bool mqtt_connect() {
+  bool auth = mqttSettings.enableAuth;
+
+  if (mqtt.connected())
+    return true;
+  mqttConnectMillis = millis();
+  if (!mqtt.connect(clientname, auth ? mqttSettings.username : NULL, auth ? mqttSettings.password : NULL,
+      willTopic, 1, true, "offline", MQTT_CLEAN_SESSION))
+    return false;
+
+  Serial.printf("MQTT: connected to broker %s as %s.\n", mqttSettings.broker, clientname);
+  mqtt.publish(willTopic, "online", true);
+  mqtt_status();
+#ifdef MQTT_HA_DISCOVERY
+  if (!mqttSettings.enableJSON)  // JSON readings share a topic with other devices
+    mqtt_discovery();
+#endif
+  return true;
+}
+
+
+// send sensor data as JSON (queued while broker is unreachable)
+static bool mqttJSON() {
+  char buf[32];
 
   Serial.printf("MQTT: publish readings as JSON to %s/%s...",
     mqttSettings.broker, mqttSettings.topic);
 
-  size_t s = serializeJson(JSON, buf);
-  if (mqtt.publish(mqttSettings.topic, buf, s)) {
+  if (mqtt_flush() && mqtt_status()) {
     blink_leds(SYSTEM_LED1, ORANGE, 100, 2, true);
     mqttMessageCount++;
     Serial.println(F("OK."));
@@ -111,58 +275,88 @@ static bool mqttJSON() {
 static bool mqttSingle() {
   static char topicStr[96], buf[128];
   char valueStr[8];
-  uint8_t count = 0;
+  uint8_t count = 0, expected = 2;
 
   Serial.printf("MQTT: publish readings to %s/%s/%s...",
       mqttSettings.broker, mqttSettings.topic, systemID().c_str());
 
-  if (co2status > WARMUP && co2status <= ALARM) {
+  if (snapshot.status > WARMUP && snapshot.status <= ALARM) {
+    expected += hasBME280 ? 6 : 5;
     memset(topicStr, 0, sizeof(topicStr));
-    itoa(scd30_co2ppm, valueStr, 10);
+    fmt_uint(valueStr, snapshot.co2ppm);
     sprintf(topicStr, "%s/%s/co2median", mqttSettings.topic, systemID().c_str());
     if (mqtt.publish(topicStr, valueStr))
       count++;
 
     delay(MQTT_PUSH_DELAY_MS);
     memset(topicStr, 0, sizeof(topicStr));
-    dtostrf(bme280_temperature, 5, 2, valueStr);
+    fmt_fixed(valueStr, snapshot.temperature, 2, 2);
     sprintf(topicStr, "%s/%s/temperature", mqttSettings.topic, systemID().c_str());
-    if (mqtt.publish(topicStr, removeSpaces(valueStr)))
+    if (mqtt.publish(topicStr, valueStr))
       count++;
 
     delay(MQTT_PUSH_DELAY_MS);
     memset(topicStr, 0, sizeof(topicStr));
-    itoa(bme280_pressure, valueStr, 10);
+    fmt_uint(valueStr, snapshot.pressure);
     sprintf(topicStr, "%s/%s/pressure", mqttSettings.topic, systemID().c_str());
-    if (mqtt.publish(topicStr, removeSpaces(valueStr)))
+    if (mqtt.publish(topicStr, valueStr))
       count++;
 
     if (hasBME280) {
       delay(MQTT_PUSH_DELAY_MS);
       memset(topicStr, 0, sizeof(topicStr));
-      itoa(bme280_humidity, valueStr, 10);
+      fmt_uint(valueStr, snapshot.humidity);
       sprintf(topicStr, "%s/%s/hum", mqttSettings.topic, systemID().c_str());
       if (mqtt.publish(topicStr, valueStr))
         count++;
     }
+
+    delay(MQTT_PUSH_DELAY_MS);
+    memset(topicStr, 0, sizeof(topicStr));
+    fmt_int(valueStr, snapshot.trend);
+    sprintf(topicStr, "%s/%s/trend", mqttSettings.topic, systemID().c_str());
+    if (mqtt.publish(topicStr, valueStr))
+      count++;
+
+    // -1 if no threshold is reached soon
+    delay(MQTT_PUSH_DELAY_MS);
+    memset(topicStr, 0, sizeof(topicStr));
+    fmt_int(valueStr, snapshot.forecast);
+    sprintf(topicStr, "%s/%s/forecast", mqttSettings.topic, systemID().c_str());
+    if (mqtt.publish(topicStr, valueStr))
+      count++;
   }
   
   delay(MQTT_PUSH_DELAY_MS);
   memset(topicStr, 0, sizeof(topicStr));
-  dtostrf(getVBAT(), 4, 2, valueStr);
+  fmt_fixed(valueStr, snapshot.vbat, 3, 2);
   sprintf(topicStr, "%s/%s/vbat", mqttSettings.topic, systemID().c_str());
-  if (mqtt.publish(topicStr, removeSpaces(valueStr)))
+  if (mqtt.publish(topicStr, valueStr))
     count++;
 
+  if (snapshot.vbat > VBAT_CONNECTED_MV) {
+    delay(MQTT_PUSH_DELAY_MS);
+    expected++;
+    fmt_uint(valueStr, snapshot.soc);
+    sprintf(topicStr, "%s/%s/soc", mqttSettings.topic, systemID().c_str());
+    if (mqtt.publish(topicStr, valueStr))
+      count++;
+    if (snapshot.runtime >= 0) {
+      delay(MQTT_PUSH_DELAY_MS);
+      expected++;
+      fmt_int(valueStr, snapshot.runtime);
+      sprintf(topicStr, "%s/%s/runtime", mqttSettings.topic, systemID().c_str());
+      if (mqtt.publish(topicStr, valueStr))
+        count++;
+    }
+  }
+
   delay(MQTT_PUSH_DELAY_MS); 
   memset(topicStr, 0, sizeof(topicStr));
-  itoa(co2status, valueStr, 10);
-  sprintf(topicStr, "%s/%s/status", mqttSettings.topic, systemID().c_str());
-  if (mqtt.publish(topicStr, statusNames[co2status]))
+  if (mqtt_status())
     count++;
 
-  if (count == 6 || (count == 5 && !hasBME280) ||
-    ((co2status > ALARM  || co2status <= WARMUP ) && count == 2)) {
+  if (count == expected) {
     blink_leds(SYSTEM_LED1, ORANGE, 100, 2, true);
     mqttMessageCount++;
     sprintf(buf, "mqtt single publish %d", mqttMessageCount);
@@ -185,22 +379,22 @@ bool mqtt_init() {
   if (mqttInited)
     return true;
 
-  if (!wifi_uplink(false)) {
-    Serial.println(F("MQTT: failed to start, no WiFi uplink."));
-    return false;
-  }
-  
   if (mqttSettings.enabled && strlen(mqttSettings.broker) >= 4) {
     Serial.println(F("MQTT started."));
     sprintf(buf, "mqtt started, %s/%s", mqttSettings.broker, mqttSettings.topic);
     logMsg(buf);
     mqtt.setServer(mqttSettings.broker, MQTT_PORT);
-    name = String(MQTT_CLIENT_NAME).substring(0,48) + "-" + systemID() + "-" + String(random(0xffff), HEX);
-    sprintf(clientname, name.c_str(), name.length());
+    mqtt.setSocketTimeout(MQTT_SOCKET_TIMEOUT_SECS);
+    mqtt.setBufferSize(MQTT_BUFFER_SIZE);
+    // broker considers device offline after missing 1.5 push intervals
+    mqtt.setKeepAlive(mqttSettings.pushInterval * 3 / 2);
+    // stable client ID to resume session after reconnect
+    name = String(MQTT_CLIENT_NAME).substring(0,48) + "-" + systemID();
+    strncpy(clientname, name.c_str(), sizeof(clientname)-1);
+    sprintf(willTopic, "%s/%s/availability", mqttSettings.topic, systemID().c_str());
     blink_leds(SYSTEM_LEDS, ORANGE, 100, 2, true);
     mqttInited = true;
   }
-  delay(1000);
   return mqttInited;
 }
 
@@ -210,41 +404,67 @@ void mqtt_stop() {
     return;
   Serial.println(F("MQTT stopped."));
   mqttInited = false;
-  mqtt.disconnect(); 
+  if (mqtt.connected())  // clean disconnect doesn't trigger last will
+    mqtt.publish(willTopic, "offline", true);
+  mqtt.disconnect();
+  queueInFlight = 0;
 }
 
 
-// try to publish sensor reedings with given timeout either 
-// as a single json strings or each reading on its own topic
+// try to publish sensor reedings with given timeout either
+// as a single json strings or each reading on its own topic;
+// JSON readings are queued if broker is unreachable
 // will implicitly call mqtt_init()
 bool mqtt_send(uint16_t timeoutMillis) {
-  uint8_t retries = 0;
+  uint32_t start = millis();
 
   save_leds();
-  if (!mqttInited)
-    mqtt_init();
+  if (!mqttInited && !mqtt_init())
+    return false;
+  if (mqttSettings.enableJSON)
+    mqtt_enqueue(snapshot_json(JSON_MQTT));
 
   if (!wifi_uplink(false)) {
-    Serial.println(F("MQTT: cannot send, no WiFi uplink."));
+    Serial.printf("MQTT: cannot send, no WiFi uplink (%d queued).\n", queueLen);
+    logMsg("mqtt failed (no wifi)");
     return false;
   }
-  
-  while (retries++ < int(timeoutMillis/100)) {
-    if (mqtt.connected()) {
-      if (mqttSettings.enableJSON)
-        return mqttJSON();
-      else
-        return mqttSingle();
+
+  while (!mqtt_connect()) {
+    if (millis() - start >= timeoutMillis) {
+      Serial.println(F("MQTT: failed to connect to broker."));
+      logMsg("mqtt failed (connect error)");
+      return false;
     }
-    if (mqttSettings.enableAuth)
-      mqtt.connect(clientname, mqttSettings.username, mqttSettings.password);
-    else
-      mqtt.connect(clientname);
     delay(100);
   }
-  Serial.println(F("MQTT: failed to connect to broker."));
-  logMsg("mqtt failed (connect error)");
-  return false;
+  mqtt_exposure();
+  if (mqttSettings.enableJSON)
+    return mqttJSON();
+  else
+    return mqttSingle();
+}
+
+
+// keep connection (and thus last will) alive, called once per second;
+// drops readings in flight while connected, resends them after reconnect
+void mqtt_loop() {
+  if (!mqttInited)
+    return;
+
+  if (mqtt.loop()) {
+    queueHead = (queueHead + queueInFlight) % MQTT_QUEUE_SIZE;
+    queueLen -= queueInFlight;
+    queueInFlight = 0;
+    return;
+  }
+
+  queueInFlight = 0;
+  if (wifi_uplink(false) && (millis() - mqttConnectMillis) > (MQTT_RECONNECT_SECS * 1000UL) &&
+      mqtt_connect() && queueLen) {
+    Serial.printf("MQTT: resending %d queued readings.\n", queueLen);
+    mqtt_flush();
+  }
 }
 
 
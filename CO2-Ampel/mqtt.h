@@ -22,6 +22,13 @@
 #endif
 #define MQTT_CLIENT_NAME "co2ampel"
 #define MQTT_PUSH_DELAY_MS 50
+#define MQTT_SOCKET_TIMEOUT_SECS 2
+#define MQTT_RECONNECT_SECS 15
+#define MQTT_QUEUE_SIZE 4  // JSON readings kept while broker is unreachable
+#define MQTT_BUFFER_SIZE 512  // Home Assistant discovery configs
+#ifndef MQTT_CLEAN_SESSION
+#define MQTT_CLEAN_SESSION false
+#endif
 #ifndef MQTT_PUSH_INTERVAL_SECS
 #define MQTT_PUSH_INTERVAL_SECS 60
 #endif
@@ -43,6 +50,7 @@ extern mqttprefs_t mqttSettings;
 bool mqtt_init();
 void mqtt_stop();
 bool mqtt_send(uint16_t timeoutMillis);
+void mqtt_loop();
 uint16_t mqtt_messages();
 void loadMQTTSettings();
 bool saveMQTTSettings();
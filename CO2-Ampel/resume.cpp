@@ -0,0 +1,123 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "resume.h"
+#include "sensors.h"
+#include "led.h"
+
+bool resumed = false;
+static uint32_t runtimeBase = 0;
+
+// RTC user memory has 512 bytes
+static_assert(RTCMEM_RESUME_OFFSET * 4 + sizeof(resume_t) <= 512, "resume_t too large");
+
+
+// copy running median window to state, returns number of samples
+static uint8_t saveWindow(RunningMedian &readings, float *window, uint8_t size) {
+  uint8_t count = min(readings.getCount(), size);
+
+  for (uint8_t i = 0; i < count; i++)
+    window[i] = readings.getElement(i);
+  return count;
+}
+
+
+static void loadWindow(RunningMedian &readings, const float *window, uint8_t count) {
+  readings.clear();
+  for (uint8_t i = 0; i < count; i++)
+    readings.add(window[i]);
+}
+
+
+// save device state to RTC user memory before entering deep sleep
+void resume_save(uint32_t sleepSecs) {
+  resume_t state;
+
+  memset(&state, 0, sizeof(state));  // zero padding bytes for CRC
+  memcpy((void*)&state.settings, &settings, sizeof(settings));
+  memcpy((void*)&state.power, &powerSettings, sizeof(powerSettings));
+  state.runtimeSecs = runtimeBase + millis()/1000;
+  state.sleepSecs = sleepSecs;
+  state.co2Samples = saveWindow(scd30_co2_readings, state.co2Readings, 15);
+  state.lowPowerSamples = saveWindow(scd30_co2_lowpower, state.co2LowPower,
+    SCD30_LOWPOWER_SAMPLES_MEDIAN);
+  state.vbatSamples = saveWindow(vbat_readings, state.vbatReadings, VBAT_SAMPLES_MEDIAN);
+  state.status = co2status;
+  state.co2ppm = scd30_co2ppm;
+  state.crc = crc16((uint8_t *) &state, offsetof(resume_t, crc));
+  if (!ESP.rtcUserMemoryWrite(RTCMEM_RESUME_OFFSET, (uint32_t *) &state, sizeof(state)))
+    Serial.println(F("Failed to save state to RTC memory!"));
+}
+
+
+// restore device state after wake up from deep sleep; the SCD30 stays
+// powered (in low power mode) while sleeping, so it doesn't need to
+// warm up again and most delays in setup() can be skipped
+bool resume_load() {
+  resume_t state;
+
+  if (runmode != WAKEUP)
+    return false;
+
+  if (!ESP.rtcUserMemoryRead(RTCMEM_RESUME_OFFSET, (uint32_t *) &state, sizeof(state)) ||
+      crc16((uint8_t *) &state, offsetof(resume_t, crc)) != state.crc) {
+    Serial.println(F("No valid state in RTC memory, full startup."));
+    return false;
+  }
+
+  memcpy((void*)&settings, &state.settings, sizeof(settings));
+  memcpy((void*)&powerSettings, &state.power, sizeof(powerSettings));
+  runtimeBase = state.runtimeSecs;
+
+  // readings are outdated after a longer sleep (e.g. NOOP at night),
+  // start with empty filter windows and wait for a new reading
+  if (state.sleepSecs > RESUME_MAX_INTERVALS * sensors_interval()) {
+    state.co2Samples = state.lowPowerSamples = state.vbatSamples = 0;
+    state.status = NODATA;
+  }
+  loadWindow(scd30_co2_readings, state.co2Readings, state.co2Samples);
+  loadWindow(scd30_co2_lowpower, state.co2LowPower, state.lowPowerSamples);
+  loadWindow(vbat_readings, state.vbatReadings, state.vbatSamples);
+
+  // restore last air quality status, but not NOOP or any other
+  // status which is only left by a restart or a new reading
+  switch (state.status) {
+    case GOOD:
+      set_leds(QUARTER_RING, GREEN);
+      break;
+    case MEDIUM:
+      set_leds(HALF_RING, YELLOW);
+      break;
+    case CRITICAL:
+    case ALARM:  // blinking is done in loop()
+      set_leds(HALF_RING, RED);
+      break;
+    default:
+      state.status = NODATA;
+  }
+  co2status = (sensorStatus) state.status;
+  if (co2status != NODATA)  // published before first new reading
+    scd30_co2ppm = state.co2ppm;
+
+  // state is only valid for one wake up
+  state.crc = ~state.crc;
+  ESP.rtcUserMemoryWrite(RTCMEM_RESUME_OFFSET, (uint32_t *) &state, sizeof(state));
+
+  Serial.printf("Resuming after %d secs with %d samples, status %s, runtime %s.\n",
+    state.sleepSecs, state.co2Samples, statusNames[co2status], getRuntime(runtimeBase));
+  resumed = true;
+  return true;
+}
+
+
+// returns runtime before last deep sleep
+uint32_t resume_runtime() {
+  return runtimeBase;
+}
@@ -0,0 +1,49 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _RESUME_H
+#define _RESUME_H
+
+#include <Arduino.h>
+#include "rtc.h"
+#include "utils.h"
+#include "sensors.h"
+
+// stored right after the deep sleep chain counter
+#define RTCMEM_RESUME_OFFSET (RTCMEM_SLEEP_OFFSET + 2)
+
+// readings and status are only restored if the device slept
+// for at most this many reading intervals
+#define RESUME_MAX_INTERVALS 3
+
+// device state kept in RTC user memory during deep sleep
+typedef struct {
+  sysprefs_t settings;
+  powerprefs_t power;
+  uint32_t runtimeSecs;
+  uint32_t sleepSecs;
+  float co2Readings[15];
+  float co2LowPower[SCD30_LOWPOWER_SAMPLES_MEDIAN];
+  float vbatReadings[VBAT_SAMPLES_MEDIAN];
+  uint8_t co2Samples;
+  uint8_t lowPowerSamples;
+  uint8_t vbatSamples;
+  uint8_t status;
+  uint16_t co2ppm;  // last filtered reading
+  uint16_t crc;
+} resume_t;
+
+extern bool resumed;
+
+void resume_save(uint32_t sleepSecs);
+bool resume_load();
+uint32_t resume_runtime();
+
+#endif
@@ -12,6 +12,7 @@
 #include "led.h"
 #include "logging.h"
 #include "utils.h"
+#include "resume.h"
 
 RTC_DS3231 rtc;
 
@@ -26,8 +27,14 @@ Timezone CE(CEST, CET);  // Frankfurt, Paris
 
 bool rtcOK = false;
 sysprefs_t settings;
+powerprefs_t powerSettings;
 uEEPROMLib rtceeprom(0x57);
 
+// stored layout of deployed devices, new settings need their own slot
+static_assert(offsetof(sysprefs_t, crc) == 58, "sysprefs_t layout changed");
+
+static uint32_t rtcEpoch = 0, rtcEpochMillis = 0, rtcSyncMillis = 0;
+
 
 // preset settings struct with defaults from config.h
 static void setDefault(sysprefs_t *s) {
@@ -46,7 +53,7 @@ static void setDefault(sysprefs_t *s) {
   s->endSleep = END_SLEEP_HOUR;
   s->loggingInterval = LOGGING_INTERVAL_SECS;
   s->altitude = ALTITUDE_ABOVE_SEELEVEL;
-  s->medianFilter = true;
+  s->co2Filter = CO2_FILTER;
 #ifdef ENABLE_NOOP
   s->enableNOOP = true;
 #endif
@@ -64,6 +71,15 @@ static void setDefault(sysprefs_t *s) {
 }
 
 
+static void setDefault(powerprefs_t *s) {
+  memset(s, 0, sizeof(*s));
+#ifdef ENABLE_LOWPOWER
+  s->lowPower = true;
+#endif
+  s->crc = crc16((uint8_t *) s, offsetof(powerprefs_t, crc));
+}
+
+
 static bool printGeneralSettings(sysprefs_t *s) {
 #ifdef SETTINGS_DEBUG
   Serial.printf("scd30TempOffset: %d\n", s->scd30TempOffset);
@@ -73,7 +89,8 @@ static bool printGeneralSettings(sysprefs_t *s) {
   Serial.printf("co2ThresholdHysteresis: %d\n", s->co2ThresholdHysteresis);
   Serial.printf("co2ReadingInterval: %d\n", s->co2ReadingInterval);
   Serial.printf("co2MedianSamples: %d\n", s->co2MedianSamples);
-  Serial.printf("medianFilter: %d\n", s->medianFilter);
+  Serial.printf("co2Filter: %d\n", s->co2Filter);
+  Serial.printf("lowPower: %d\n", powerSettings.lowPower);
   Serial.printf("enableNOOP: %d\n", s->enableNOOP);
   Serial.printf("beginSleep: %d\n", s->beginSleep);
   Serial.printf("endSleep: %d\n", s->endSleep);
@@ -89,45 +106,95 @@ static bool printGeneralSettings(sysprefs_t *s) {
 }
 
 
+// a missing DS3231 only disables time keeping (NTP time is used
+// as fallback if available) so the system keeps on measuring
 void rtc_init() {
-  if (!rtc.begin()) {
-    Serial.println(F("Couldn't find RTC...system halted."));
+  if (!i2c_present(I2C_DS3231) || !rtc.begin()) {
+    Serial.println(F("Couldn't find RTC, time keeping disabled!"));
     logMsg("rtc error");
-    while (1) {
-      blink_leds(HALF_RING, RED, 500, 2, false);
-      delay(2000);
-    }
+    blink_leds(HALF_RING, RED, 500, 2, false);
+    return;
   }
   rtc.disable32K();
   rtc_temperature();
-  blink_leds(SYSTEM_LEDS, GREEN, 100, 2, false);
   rtcOK = true;
-  delay(1000);
+  if (!resumed)
+    blink_leds(SYSTEM_LEDS, GREEN, 100, 2, false);
+}
+
+
+// read current time from DS3231 and use it as new base for rtc_now()
+static void rtc_sync() {
+  uint32_t start;
+  DateTime now;
+
+  rtcSyncMillis = millis();  // also limits retries on failure
+  start = i2c_begin(I2C_DS3231);
+  now = rtc.now();
+  // RTClib doesn't report bus errors, check for plausible date instead
+  if (!i2c_end(I2C_DS3231, start, now.month() >= 1 && now.month() <= 12 && now.day() <= 31))
+    return;
+  rtcEpoch = now.unixtime();
+  rtcEpochMillis = rtcSyncMillis;
+}
+
+
+// returns current time (UTC) as unix epoch or 0 if not available;
+// the DS3231 is only read every RTC_RESYNC_SECS, in between time
+// is advanced with millis()
+uint32_t rtc_now() {
+  if (!rtcOK)
+    return (timeClient.getEpochTime() > 1605441600) ? timeClient.getEpochTime() : 0;
+
+  if (!rtcEpoch || (millis() - rtcSyncMillis >= RTC_RESYNC_SECS * 1000))
+    rtc_sync();
+  if (!rtcEpoch)
+    return 0;
+  return rtcEpoch + (millis() - rtcEpochMillis) / 1000;
+}
+
+
+// returns current local time or 0 if not available; since DST
+// changes only occur on full hours the UTC offset is cached
+// until the next hour boundary
+time_t rtc_local() {
+  static uint32_t offsetUntil = 0;
+  static int32_t offset = 0;
+  uint32_t utc = rtc_now();
+
+  if (!utc)
+    return 0;
+  if (utc >= offsetUntil || utc + 3600 < offsetUntil) {  // also handle time jumps
+    offset = CE.toLocal(utc) - utc;
+    offsetUntil = utc - (utc % 3600) + 3600;
+  }
+  return utc + offset;
 }
 
 
 void rtc_temperature() {
+  if (!rtcOK)
+    return;
   Serial.print(F("DS3231: temp("));
   Serial.print(rtc.getTemperature(), 1);
   Serial.println("C)");
 }
 
 
-// returns ptr to array with current time
+// returns ptr to array with current time (formatted once per second)
 char* getTimeString(bool showsecs) {
   static char strTime[9]; // HH:MM:SS
-  uint32_t epochTime = 0;
-  DateTime now;
-  time_t t;
+  static time_t lastTime = 1;
+  static bool lastSecs;
+  time_t t = rtc_local();
 
-  if (rtcOK) {
-    now = rtc.now();
-    epochTime = now.unixtime();
-  }  
-  t = CE.toLocal(epochTime);
+  if (t == lastTime && showsecs == lastSecs)
+    return strTime;
+  lastTime = t;
+  lastSecs = showsecs;
 
   memset(strTime, 0, sizeof(strTime));
-  if (epochTime > 1605441600) {  // 15.11.2020
+  if (t > 1605441600) {  // 15.11.2020
     if (showsecs)
       sprintf(strTime, "%.2d:%.2d:%.2d", hour(t), minute(t), second(t));
     else
@@ -142,20 +209,17 @@ char* getTimeString(bool showsecs) {
 }
 
 
-// returns ptr to array with current date
+// returns ptr to array with current date (formatted once per second)
 char* getDateString() {
   static char strDate[11]; // DD.MM.YYYY
-  uint32_t epochTime = 0;
-  DateTime now;
-  time_t t;
+  static time_t lastTime = 1;
+  time_t t = rtc_local();
 
-  if (rtcOK) {
-    now = rtc.now();
-    epochTime = now.unixtime();
-  }  
-  t = CE.toLocal(epochTime);
+  if (t == lastTime)
+    return strDate;
+  lastTime = t;
 
-  if (epochTime > 1605441600) {
+  if (t > 1605441600) {
     sprintf(strDate, "%.2d.%.2d.%4d", day(t), month(t), year(t));
   } else {
     strncpy(strDate, "--.--.----", 10); 
@@ -166,8 +230,10 @@ char* getDateString() {
 
 // return current hour (local time)
 int8_t getHourLocal() {
-  if (rtcOK) {
-    return hour(CE.toLocal(rtc.now().unixtime()));
+  time_t t = rtc_local();
+
+  if (t) {
+    return hour(t);
   } else {
     return -1;
   }
@@ -181,9 +247,11 @@ bool startNTPSync() {
   timeClient.forceUpdate(); // takes a while
   if (timeClient.getEpochTime() > 1000) {
     Serial.println(F("OK."));
-    rtc.adjust(DateTime(timeClient.getEpochTime()));
+    if (rtcOK) {
+      rtc.adjust(DateTime(timeClient.getEpochTime()));
+      rtcEpoch = 0;  // force resync on next rtc_now()
+    }
     logMsg("ntp sync");
-    delay(1000);
     return true;
   } else {
     Serial.println(F("failed!"));
@@ -200,10 +268,13 @@ void stopNTPSync() {
 // read general device settings from DS3231 EEPROM
 void loadGeneralSettings() {
   sysprefs_t buf;
+  powerprefs_t pbuf;
 
   memset(&settings, 0, sizeof(settings));
   setDefault(&settings);  // set struct with defaults values from config.h
   loadSettings(&settings, &buf, offsetof(sysprefs_t, crc), EEPROM_SYSTEM_PREFS_ADDR, "general settings");
+  setDefault(&powerSettings);
+  loadSettings(&powerSettings, &pbuf, offsetof(powerprefs_t, crc), EEPROM_POWER_PREFS_ADDR, "power settings");
   printGeneralSettings(&settings);
 }
 
@@ -212,7 +283,10 @@ void loadGeneralSettings() {
 bool saveGeneralSettings() {
   if (settings.crc) { // use an existing crc as flag for a valid settings struct
     settings.crc = crc16((uint8_t *) &settings, offsetof(sysprefs_t, crc)); // to reflect changes (web ui)
-    return saveSettings(settings, EEPROM_SYSTEM_PREFS_ADDR, "general settings") && printGeneralSettings(&settings);
+    powerSettings.crc = crc16((uint8_t *) &powerSettings, offsetof(powerprefs_t, crc));
+    return saveSettings(settings, EEPROM_SYSTEM_PREFS_ADDR, "general settings") &&
+      saveSettings(powerSettings, EEPROM_POWER_PREFS_ADDR, "power settings") &&
+      printGeneralSettings(&settings);
   }
   return false;
 }
@@ -224,5 +298,7 @@ bool resetGeneralSettings() {
   logMsg("reset general settings");
   memset(&settings, 0, sizeof(settings));
   setDefault(&settings);
+  setDefault(&powerSettings);
+  saveSettings(powerSettings, EEPROM_POWER_PREFS_ADDR, "power settings");
   return saveSettings(settings, EEPROM_SYSTEM_PREFS_ADDR, "general settings") && printGeneralSettings(&settings);
 }
@@ -23,9 +23,12 @@
 #include "logging.h"
 #include "utils.h"
 #include "config.h"
+#include "i2cbus.h"
 
 #define NTP_ADDRESS "de.pool.ntp.org"
 #define EEPROM_SYSTEM_PREFS_ADDR 0x10
+#define EEPROM_POWER_PREFS_ADDR 0xE0
+#define RTC_RESYNC_SECS 600  // re-read DS3231 to compensate for millis() drift
 
 #if SCD30_INTERVAL_SECS < SCD30_INTERVAL_MIN_SECS
 #define SCD30_INTERVAL_SECS SCD30_INTERVAL_MIN_SECS
@@ -53,7 +56,7 @@ typedef struct {
   uint16_t co2ThresholdHysteresis;
   uint16_t co2ReadingInterval;
   uint16_t co2MedianSamples;
-  bool medianFilter;
+  uint8_t co2Filter;  // see co2Filter in sensors.h
   bool enableNOOP;
   uint8_t beginSleep;
   uint8_t endSleep;
@@ -66,10 +69,20 @@ typedef struct {
   uint16_t crc = 0;
 } sysprefs_t;
 
+// power settings added later, stored apart from sysprefs_t
+// to keep its layout (and CRC) of deployed devices valid
+typedef struct {
+  bool lowPower;
+  uint16_t crc = 0;
+} powerprefs_t;
+
 extern sysprefs_t settings;
+extern powerprefs_t powerSettings;
 extern uEEPROMLib rtceeprom;
 
 void rtc_init();
+uint32_t rtc_now();
+time_t rtc_local();
 void rtc_temperature();
 char* getDateString();
 char* getTimeString(bool showsecs);
@@ -86,13 +99,17 @@ template <typename T, typename S>
 void loadSettings(T *t, S *s, uint8_t crclen, uint16_t addr, const char* name) {
   char buf[32];
   bool error = false;
+  uint32_t start;
 
-  if (!rtcOK)
-    rtc_init();
+  if (!i2c_present(I2C_EEPROM)) {
+    Serial.printf("No EEPROM, using default %s.\n", name);
+    return;
+  }
 
   Serial.printf("Loading %s (%d bytes) from EEPROM...", name, sizeof(*t));
   memset(s, 0, sizeof(*s));
-  if (!rtceeprom.eeprom_read(addr, (byte *) s, sizeof(*s))) {
+  start = i2c_begin(I2C_EEPROM);
+  if (!i2c_end(I2C_EEPROM, start, rtceeprom.eeprom_read(addr, (byte *) s, sizeof(*s)))) {
     Serial.print(F("eeprom failed, ")); // fallback to default values?
     sprintf(buf, "load %s eeprom failed", name);
     logMsg(buf);
@@ -125,12 +142,16 @@ void loadSettings(T *t, S *s, uint8_t crclen, uint16_t addr, const char* name) {
 template <typename T>
 bool saveSettings(T t, uint16_t addr, const char* name) {
   char buf[32];
+  uint32_t start;
+
+  if (!i2c_present(I2C_EEPROM)) {
+    Serial.printf("No EEPROM, cannot save %s!\n", name);
+    return false;
+  }
 
-  if (!rtcOK)
-    rtc_init();
-  
   Serial.printf("Saving %s to EEPROM address 0x%04x...", name, addr);
-  if (!rtceeprom.eeprom_write(addr, &t, sizeof(t))) {
+  start = i2c_begin(I2C_EEPROM);
+  if (!i2c_end(I2C_EEPROM, start, rtceeprom.eeprom_write(addr, &t, sizeof(t)))) {
     sprintf(buf, "save %s failed", name);
     logMsg(buf);
     Serial.println(F("failed!"));
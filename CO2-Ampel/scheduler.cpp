@@ -0,0 +1,93 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "scheduler.h"
+#include "sensors.h"
+#include "logging.h"
+#include "rtc.h"
+
+// next NOOP begin or end (UTC) and the settings it was computed for
+static uint32_t nextEvent = 0, noopEnd = 0;
+static uint8_t schedBegin, schedEnd;
+static bool noopWindow = false;
+
+
+// UTC epoch of a full local hour; an hour skipped by the change
+// to summer time starts with the change
+static uint32_t hourToUTC(time_t local) {
+  time_t utc = CE.toUTC(local);
+
+  if (CE.toLocal(utc) != local)
+    utc = CE.toUTC(local + SECS_PER_HOUR);
+  return utc;
+}
+
+
+// returns UTC epoch of the next full local hour 'hh:00' after given
+// UTC epoch; conversion to UTC applies the DST rules of the given day
+static uint32_t nextLocalHour(uint32_t utc, uint8_t hh) {
+  time_t local = CE.toLocal(utc);
+  time_t t = local - (local % SECS_PER_DAY) + hh * SECS_PER_HOUR;
+
+  while (hourToUTC(t) <= utc)
+    t += SECS_PER_DAY;
+  return hourToUTC(t);
+}
+
+
+// returns true during NOOP time; the next begin and end of the NOOP
+// window are computed once and only recomputed when a boundary has
+// passed, the settings have changed or the clock was adjusted
+bool checkNOOPTime(uint8_t begin_hour, uint8_t end_hour) {
+  static char buf[64];
+  uint32_t utc, b;
+
+  if (!settings.enableNOOP)
+      return false;
+
+  // check for valid configuration settings
+  if (begin_hour == end_hour || begin_hour > 23 || end_hour > 23)
+    return false;
+
+  // abort due to invalid RTC time
+  utc = rtc_now();
+  if (year(utc) < 2020)
+    return false;
+
+  if (!nextEvent || utc >= nextEvent || utc + SECS_PER_DAY < nextEvent ||
+      begin_hour != schedBegin || end_hour != schedEnd) {
+    b = nextLocalHour(utc, begin_hour);
+    noopEnd = nextLocalHour(utc, end_hour);
+    noopWindow = (noopEnd < b); // window ends before it begins again
+    nextEvent = min(b, noopEnd);
+    schedBegin = begin_hour;
+    schedEnd = end_hour;
+  }
+
+  if (noopWindow && co2status != NOOP) {
+    co2status = NOOP;
+    Serial.printf("NOOP from %.2d:00 to %.2d:00\n", begin_hour, end_hour);
+    sprintf(buf, "noop %.2d:00-%.2d:00", begin_hour, end_hour);
+    logMsg(buf);
+  }
+
+  return noopWindow;
+}
+
+
+// returns secs until current NOOP window ends, at least 1 sec
+// so the system restarts right away if the end has just passed
+uint32_t noopRemainingSecs() {
+  uint32_t utc = rtc_now();
+
+  if (!noopWindow || !utc || noopEnd <= utc)
+    return 1;
+  return noopEnd - utc;
+}
@@ -0,0 +1,19 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include <Arduino.h>
+
+bool checkNOOPTime(uint8_t begin_hour, uint8_t end_hour);
+uint32_t noopRemainingSecs();
+
+#endif
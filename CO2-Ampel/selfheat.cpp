@@ -0,0 +1,127 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "selfheat.h"
+#include "led.h"
+#include "rtc.h"
+#include "utils.h"
+#include "format.h"
+
+// self-heating of the SCD30 (its temperature minus the BME280's) is
+// modelled as a linear function of the power state; since the housing
+// warms up slowly, inputs are passed through a first order lag with
+// the thermal time constant, so the model also predicts transients
+// right after a mode change; unlike the per reading conversions, the
+// model stays in float: its covariance spans more than ten decades,
+// which fixed point can't hold, and an update every reading interval
+// (at least 5 secs) costs about a hundred soft float operations
+static selfheat_t model;
+static float inputs[SELFHEAT_INPUTS];  // lagged
+static uint32_t lastInputs = 0;
+
+
+// called once per second with current power state
+void selfheat_inputs(bool wifi, uint8_t leds, uint16_t intervalSecs) {
+  float x[SELFHEAT_INPUTS] = { 1.0, wifi ? 1.0f : 0.0f, float(leds) / NUM_PIXELS,
+    2.0f / max(intervalSecs, uint16_t(2)) };  // 1 at max. measurement rate
+  uint32_t now = millis()/1000;
+  float a;
+
+  // start in steady state
+  if (!lastInputs) {
+    memcpy(inputs, x, sizeof(inputs));
+    lastInputs = now;
+    return;
+  }
+  a = min(float(now - lastInputs) / SELFHEAT_TAU_SECS, 1.0f);
+  lastInputs = now;
+  for (uint8_t i = 0; i < SELFHEAT_INPUTS; i++)
+    inputs[i] += (x[i] - inputs[i]) * a;
+}
+
+
+// update model with paired reading (raw SCD30 minus BME280 temperature),
+// constant time and memory per reading
+void selfheat_learn(int16_t residual) {
+  float Px[SELFHEAT_INPUTS], k[SELFHEAT_INPUTS];
+  float denom = SELFHEAT_LAMBDA, err = residual, trace = 0;
+  uint8_t i, j;
+
+  if (!lastInputs)
+    return;
+
+  for (i = 0; i < SELFHEAT_INPUTS; i++) {
+    Px[i] = 0;
+    for (j = 0; j < SELFHEAT_INPUTS; j++)
+      Px[i] += model.P[i][j] * inputs[j];
+    denom += inputs[i] * Px[i];
+    err -= model.theta[i] * inputs[i];
+  }
+  for (i = 0; i < SELFHEAT_INPUTS; i++) {
+    k[i] = Px[i] / denom;
+    model.theta[i] += k[i] * err;
+  }
+
+  // P = (P - k * x'P) / lambda, forgetting only while P is bounded;
+  // P is updated as symmetric matrix, otherwise float rounding errors
+  // accumulate until P is no longer positive and the model diverges
+  for (i = 0; i < SELFHEAT_INPUTS; i++) {
+    for (j = i; j < SELFHEAT_INPUTS; j++)
+      model.P[i][j] = model.P[j][i] = model.P[i][j] - k[i] * Px[j];
+    trace += model.P[i][i];
+  }
+  if (trace < SELFHEAT_P_MAX) {
+    for (i = 0; i < SELFHEAT_INPUTS; i++)
+      for (j = 0; j < SELFHEAT_INPUTS; j++)
+        model.P[i][j] /= SELFHEAT_LAMBDA;
+  }
+  model.updates++;
+}
+
+
+// predicted self-heating in centi-°C for current (lagged) power state
+int16_t selfheat_offset() {
+  float offset = 0;
+
+  if (!lastInputs)
+    return 0;
+  for (uint8_t i = 0; i < SELFHEAT_INPUTS; i++)
+    offset += model.theta[i] * inputs[i];
+  return constrain(int32_t(lroundf(offset)), int32_t(-SELFHEAT_OFFSET_MAX), int32_t(SELFHEAT_OFFSET_MAX));
+}
+
+
+void selfheat_reset() {
+  memset(&model, 0, sizeof(model));
+  for (uint8_t i = 0; i < SELFHEAT_INPUTS; i++)
+    model.P[i][i] = SELFHEAT_P_INIT;
+}
+
+
+void loadSelfheat() {
+  selfheat_t buf;
+
+  selfheat_reset();
+  loadSettings(&model, &buf, offsetof(selfheat_t, crc), EEPROM_SELFHEAT_ADDR, "self-heating model");
+}
+
+
+bool saveSelfheat() {
+  char buf[64], *p;
+
+  p = buf + sprintf(buf, "selfheat model");
+  for (uint8_t i = 0; i < SELFHEAT_INPUTS; i++)
+    p = fmt_fixed(fmt_char(p, ' '), lroundf(model.theta[i]), 2, 2);
+  *p = '\0';
+  Serial.println(buf);
+  logMsg(buf);
+  model.crc = crc16((uint8_t *) &model, offsetof(selfheat_t, crc));
+  return saveSettings(model, EEPROM_SELFHEAT_ADDR, "self-heating model");
+}
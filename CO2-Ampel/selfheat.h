@@ -0,0 +1,39 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _SELFHEAT_H
+#define _SELFHEAT_H
+
+#include <Arduino.h>
+
+#define EEPROM_SELFHEAT_ADDR 0xC00
+#define SELFHEAT_INPUTS 4  // constant, WiFi, LEDs, measurement rate
+#define SELFHEAT_TAU_SECS 900  // thermal time constant of housing
+#define SELFHEAT_LAMBDA 0.9999  // forgetting factor, ~1 day with 10 sec. readings
+#define SELFHEAT_P_INIT 10000.0
+#define SELFHEAT_P_MAX 100000.0  // limits covariance wind-up
+#define SELFHEAT_OFFSET_MAX 500  // centi-°C
+
+// recursive least squares estimate of self-heating per input
+typedef struct {
+  float theta[SELFHEAT_INPUTS];  // centi-°C
+  float P[SELFHEAT_INPUTS][SELFHEAT_INPUTS];
+  uint32_t updates;
+  uint16_t crc = 0;
+} selfheat_t;
+
+void selfheat_inputs(bool wifi, uint8_t leds, uint16_t intervalSecs);
+void selfheat_learn(int16_t residual);
+int16_t selfheat_offset();
+void selfheat_reset();
+void loadSelfheat();
+bool saveSelfheat();
+
+#endif
@@ -13,19 +13,32 @@
 #include "logging.h"
 #include "rtc.h"
 #include "utils.h"
+#include "format.h"
 #include "config.h"
-
-float scd30_temperature;
+#include "i2cbus.h"
+#include "resume.h"
+#include "trend.h"
+#include "ventilation.h"
+#include "baseline.h"
+#include "stability.h"
+#include "selfheat.h"
+#include "kalman.h"
+#include "fixedpoint.h"
+
+int16_t scd30_temperature;  // compensated for self-heating
+static int16_t scd30_rawTemperature;  // with fixed offset only
 uint16_t scd30_co2ppm;
 uint8_t scd30_humidity;
 int16_t scd30_calibrate_countdown;
 int16_t scd30_warmup_countdown;
-float bme280_temperature;
+int16_t bme280_temperature;
 uint8_t bme280_humidity;
 uint16_t bme280_pressure;
 bool hasBME280 = false;
 static bool scd30Init = false;
 static bool bme280Init = false;
+static bool scd30Fresh = false;  // new readings not yet used for
+static bool bme280Fresh = false;  // learning self-heating
 sensorStatus co2status;
 
 char statusNames[9][10] = {
@@ -40,44 +53,44 @@ char statusNames[9][10] = {
    "noop"
  };
 
-BME280I2C bme;
+// BME280 stays in sleep mode, single conversions are triggered
+// in forced mode by bme280_forced() and read in one burst
+static BME280I2C::Settings bme280Settings(
+  BME280_OVERSAMPLING_TEMP, BME280_OVERSAMPLING_HUM, BME280_OVERSAMPLING_PRES,
+  BME280::Mode_Sleep, BME280::StandbyTime_1000ms, BME280_FILTER);
+BME280I2C bme(bme280Settings);
 SCD30 airsensor;
 uEEPROMLib eeprom(0x57);
 RunningMedian scd30_co2_readings = RunningMedian(settings.co2MedianSamples);
-RunningMedian scd30_co2_calibrate = RunningMedian(15);
-RunningMedian scd30_temp_readings = RunningMedian(9);
-RunningMedian bme280_temp_readings = RunningMedian(9);
+RunningMedian scd30_co2_lowpower = RunningMedian(SCD30_LOWPOWER_SAMPLES_MEDIAN);
 
 
-// returns standard deviation of given running median readings
-static float stdDev(RunningMedian readings, bool debug) {
-  int32_t average = 0;
-  uint32_t sqDevSum = 0.0;
-  float deviation;
+// trigger a single conversion in forced mode and wait until the
+// BME280 has finished measuring (status register bit 3)
+static bool bme280_forced() {
+  uint8_t addr = bme280Settings.bme280Addr;
+  uint32_t start = millis(), i2cStart;
+  bool ok;
 
-  if (readings.getCount() < 5)
-    return UCHAR_MAX;
-  
-  average = int(readings.getAverage()*100);
-  for(uint8_t i = 0; i < readings.getCount(); i++) {
-      sqDevSum += pow((average - (readings.getElement(i)*100)), 2);
-  }
-  deviation = sqrt(sqDevSum/readings.getCount())/100;
-
-  if (debug) {
-    Serial.print(F("Values: "));
-    for (uint8_t i = 0; i < readings.getCount(); i++) {
-      Serial.print(readings.getElement(i));
-      Serial.print(" ");
-    }
-    Serial.println();
-    Serial.print(F("Mean: " ));
-    Serial.println(average/100.0);
-    Serial.print(F("Sigma: "));
-    Serial.println(deviation);
-  }
+  i2cStart = i2c_begin(I2C_BME280);
+  Wire.beginTransmission(addr);
+  Wire.write(BME280_REG_CTRL_MEAS);
+  Wire.write((bme280Settings.tempOSR << 5) | (bme280Settings.presOSR << 2) | BME280::Mode_Forced);
+  if (!i2c_end(I2C_BME280, i2cStart, Wire.endTransmission() == 0))
+    return false;
 
-  return deviation;
+  do {
+    delay(2);
+    i2cStart = i2c_begin(I2C_BME280);
+    Wire.beginTransmission(addr);
+    Wire.write(BME280_REG_STATUS);
+    ok = (Wire.endTransmission(false) == 0 && Wire.requestFrom(addr, (uint8_t) 1) == 1);
+    if (!i2c_end(I2C_BME280, i2cStart, ok))
+      return false;
+    if (!(Wire.read() & 0x08))
+      return true;
+  } while (millis() - start < BME280_CONVERSION_TIMEOUT_MS);
+  return false;
 }
 
 
@@ -90,15 +103,14 @@ void sensors_init() {
 }
 
 
-// initaliaze BME-Sensor and return current pressure
+// initaliaze BME-Sensor and return current pressure; without
+// a BME280 there's no pressure compensation and temperature offset
 uint16_t bme280_init() {
-  if (!bme.begin()) {
-    Serial.println(F("Couldn't find BME280 sensor...system halted!"));
+  if (!i2c_present(I2C_BME280) || !bme.begin()) {
+    Serial.println(F("Couldn't find BME280 sensor, disabled!"));
     logMsg("bme280 error");
-    while (1) {
-      blink_leds(HALF_RING, RED, 500, 3, false);
-      delay(2000);
-    }
+    blink_leds(HALF_RING, RED, 500, 3, false);
+    return 0;
   }
 
   switch (bme.chipModel()) {
@@ -116,9 +128,12 @@ uint16_t bme280_init() {
         delay(2000);
       }
   }
+  Serial.printf("BME280: forced mode, oversampling t%d/p%d/h%d, filter %d\n",
+    bme280Settings.tempOSR, bme280Settings.presOSR, bme280Settings.humOSR, bme280Settings.filter);
   bme280Init = true;
-  blink_leds(SYSTEM_LEDS, GREEN, 100, 2, false);
-  delay(1000);
+  if (!resumed)
+    blink_leds(SYSTEM_LEDS, GREEN, 100, 2, false);
+  return bme280_pressure;
 }
 
 
@@ -134,7 +149,7 @@ void scd30_init(uint16_t pressure) {
       delay(2000);
     }
   } else {
-    interval = max(3, int(settings.co2ReadingInterval/2));
+    interval = scd30_interval();
     Serial.println(F("Found SCD30 air sensor.")); 
     Serial.print(F("SCD30: auto-calibration disabled, reading interval set to "));
     Serial.print(interval);
@@ -177,13 +192,56 @@ void scd30_init(uint16_t pressure) {
     Serial.print(F("SCD30: temperature offset is "));
     Serial.print(airsensor.getTemperatureOffset(), 2);
     Serial.println();
-    dtostrf(airsensor.getTemperatureOffset(), 5, 2, s);
-    sprintf(buf, "scd30 temperature offset %s", removeSpaces(s));
+    fmt_fixed(s, lroundf(airsensor.getTemperatureOffset() * 100), 2, 2);
+    sprintf(buf, "scd30 temperature offset %s", s);
     logMsg(buf);
   }
   scd30Init = true;
-  blink_leds(SYSTEM_LEDS, GREEN, 100, 2, false);
-  delay(1000);
+  if (!resumed)
+    blink_leds(SYSTEM_LEDS, GREEN, 100, 2, false);
+}
+
+
+// SCD30 measurement interval, twice as fast as readings are taken
+// unless low power mode is enabled
+uint16_t scd30_interval() {
+  if (powerSettings.lowPower)
+    return SCD30_LOWPOWER_INTERVAL_SECS;
+  return max(3, int(settings.co2ReadingInterval/2));
+}
+
+
+// interval for taking readings in loop() (lower limit 5 secs)
+uint16_t sensors_interval() {
+  if (powerSettings.lowPower)
+    return SCD30_LOWPOWER_INTERVAL_SECS;
+  return max(5, int(settings.co2ReadingInterval));
+}
+
+
+// secs after power up before readings are considered valid
+uint16_t scd30_warmup() {
+  return powerSettings.lowPower ? SCD30_LOWPOWER_WARMUP_SECS : SCD30_WARMUP_SECS;
+}
+
+
+// switch between continuous and low power mode
+void scd30_lowpower(bool enable) {
+  static char buf[48];
+
+  powerSettings.lowPower = enable;
+  if (!scd30Init)
+    return;
+  scd30_co2_lowpower.clear();
+  Serial.printf("SCD30: low power mode %s, reading interval set to %d secs",
+    enable ? "enabled" : "disabled", scd30_interval());
+  sprintf(buf, "scd30 low power mode %s", enable ? "on" : "off");
+  if (!airsensor.setMeasurementInterval(scd30_interval())) {
+    Serial.print(F(" [FAILED]"));
+    strcat(buf, " failed");
+  }
+  Serial.println();
+  logMsg(buf);
 }
 
 
@@ -195,6 +253,46 @@ void scd30_sleep() {
 }
 
 
+#ifdef SCD30_AUTO_BASELINE
+// apply pending baseline correction with forced recalibration
+// relative to current median once readings are stable and the
+// target is within the range accepted by the SCD30
+static void scd30_baseline_correct() {
+  int16_t step = baseline_pending();
+  uint16_t median, target;
+  uint32_t stddev;
+  char buf[64];
+  char s[8];
+
+  if (scd30_co2_readings.getCount() < scd30_co2_readings.getSize())
+    return;
+  stddev = stdDev(scd30_co2_readings, false);
+  if (stddev > SCD30_CALIBRATION_SIGMA_MAX)
+    return;
+  median = scd30_co2_readings.getMedian();
+  target = median + step;
+  if (target < SCD30_FRC_MIN_PPM || target > SCD30_FRC_MAX_PPM)
+    return;  // retry with next reading
+
+  fmt_fixed(s, stddev, 2, 2);
+  if (airsensor.setForcedRecalibrationFactor(target)) {
+    Serial.printf("SCD30: baseline correction %+dppm, %dppm -> %dppm, sigma %s\n",
+      step, median, target, s);
+    sprintf(buf, "scd30 baseline correction %+dppm, %dppm -> %dppm", step, median, target);
+    logMsg(buf);
+    scd30_co2_readings.clear();
+    scd30_co2_lowpower.clear();
+    kalman_reset();
+    baseline_applied(step);
+  } else {
+    Serial.println(F("SCD30: baseline correction failed!"));
+    logMsg("scd30 baseline correction failed");
+    baseline_applied(0);  // retry after cooldown
+  }
+}
+#endif
+
+
 // returns true unless we get repeated failures on readings
 // set global variables for co2ppm, humidity and temperature 
 // and print all readings to console
@@ -202,8 +300,8 @@ bool scd30_readings(bool reset) {
   static uint32_t lastReading;
   static uint8_t noCO2Reading;
   uint16_t co2ppm;
-  uint8_t retries;
-  float stddev;
+  uint8_t retries = 0;
+  uint32_t start, humidity;  // centi-%
 
   if (!scd30Init) {
     Serial.println(F("SCD30: not initialized!"));
@@ -212,39 +310,75 @@ bool scd30_readings(bool reset) {
 
   if (reset)
     noCO2Reading = 0;
+  scd30Fresh = false;
     
   while (retries++ < 4) { // repeat for 2 seconds
-    if (airsensor.readMeasurement()) {
-      // set global variables
-      scd30_temperature = airsensor.getTemperature();
-      scd30_humidity = int(airsensor.getHumidity());
-      scd30_temp_readings.add(scd30_temperature); // used for temp auto offset
+    // readMeasurement() also fails if there is no new data yet, which
+    // must not be accounted as bus error (and trigger a bus recovery)
+    if (!airsensor.dataAvailable()) {
+      Serial.println(F("SCD30: no data"));
+      noCO2Reading++;
+      delay(500);
+      continue;
+    }
+    start = i2c_begin(I2C_SCD30);
+    if (i2c_end(I2C_SCD30, start, airsensor.readMeasurement())) {
+      // set global variables, predicted self-heating is subtracted and
+      // relative humidity is converted to the compensated temperature
+      scd30_rawTemperature = lroundf(airsensor.getTemperature() * 100);
+      scd30_temperature = scd30_rawTemperature - selfheat_offset();
+      humidity = lroundf(max(airsensor.getHumidity(), 0.0f) * 100);
+      humidity = (uint64_t(humidity) * magnusRatio(scd30_rawTemperature,
+        scd30_temperature) + 32768) >> 16;
+      scd30_humidity = min((humidity + 50) / 100, uint32_t(100));
 
       co2ppm = airsensor.getCO2();
       scd30_co2_readings.add(co2ppm);
-      scd30_co2_calibrate.add(co2ppm); // only used for sensor calibration
-      if (settings.medianFilter)
+      scd30_co2_lowpower.add(co2ppm); // shorter window for 60 sec. interval
+      if (co2status == CALIBRATE)
+        stability_add(co2ppm);
+      if (co2ppm > CO2_LOWER_BOUND)
+        kalman_add(co2ppm);
+      else
+        kalman_reset();  // pass invalid reading on to trigger NODATA
+      if (settings.co2Filter == CO2_FILTER_MEDIAN && powerSettings.lowPower)
+        scd30_co2ppm = scd30_co2_lowpower.getMedian();
+      else if (settings.co2Filter == CO2_FILTER_MEDIAN)
         scd30_co2ppm = scd30_co2_readings.getMedian(); // set global variable
+      else if (settings.co2Filter == CO2_FILTER_KALMAN && kalman_ppm())
+        scd30_co2ppm = kalman_ppm();
       else
         scd30_co2ppm = co2ppm;
 
       if (co2ppm > CO2_LOWER_BOUND) {
         lastReading = millis()/1000;
         noCO2Reading = 0;
+        scd30Fresh = true;
+        if (co2status != CALIBRATE) {
+          trend_add(co2ppm);
+          ventilation_add(co2ppm);
+        }
+#ifdef SCD30_AUTO_BASELINE
+        if (co2status >= GOOD && co2status <= ALARM) {
+          baseline_add(co2ppm);
+          if (baseline_pending())
+            scd30_baseline_correct();
+        }
+#endif
         Serial.print(F("SCD30: co2("));
         Serial.print(co2ppm);
-        Serial.print(F("ppm), co2median("));
+        Serial.print(F("ppm), co2filtered("));
         Serial.print(scd30_co2ppm);
 #ifdef SCD30_DEBUG
         Serial.print(F("ppm), co2StdDev("));
-        Serial.print(stddev = stdDev(scd30_co2_readings, false));     
+        Serial.print(stdDev(scd30_co2_readings, false)/100.0);
 #endif
         Serial.print(F("ppm), temp("));
-        Serial.print(scd30_temperature, 1);
+        Serial.print(scd30_temperature/100.0, 1);
 #ifdef SCD30_DEBUG
-        Serial.print(F("C), tempStdDev("));
-        Serial.print(stdDev(scd30_temp_readings, false));
-#endif       
+        Serial.print(F("C), selfHeating("));
+        Serial.print(selfheat_offset()/100.0, 2);
+#endif
         Serial.print(F("C), hum("));
         Serial.print(scd30_humidity, 1);
         Serial.println(F("%)"));
@@ -257,7 +391,7 @@ bool scd30_readings(bool reset) {
       }
       return true;
     }
-    Serial.println(F("SCD30: no data"));
+    Serial.println(F("SCD30: read failed"));
     noCO2Reading++;
     delay(500);
   }
@@ -309,45 +443,14 @@ void scd30_pressure(uint16_t pressure) {
 }
 
 
-void scd30_adjustTempOffset() {
-  static char buf[64], s1[8], s2[8];
-  float tempDiff, tempOffset, stddev;
-
-  if (!scd30Init) {
-    Serial.println(F("SCD30: not initialized!"));
-    return;
-  } 
-  
-  if (scd30_temp_readings.getCount() < scd30_temp_readings.getSize()*0.9)
+// learn self-heating from paired SCD30 and BME280 readings,
+// skipped unless both sensors have delivered a new valid reading
+void scd30_learnSelfHeating() {
+  if (!scd30Init || !bme280Init || !scd30Fresh || !bme280Fresh)
     return;
-  
-  if (stdDev(scd30_temp_readings, false) > 0.08 || stdDev(bme280_temp_readings, false) > 0.89)
-    return; 
-
-  tempDiff = airsensor.getTemperature() - bme280_temperature;
-  tempOffset = airsensor.getTemperatureOffset() + (tempDiff*0.95);
-  if (tempOffset < 0)
-    tempOffset = 0; // offset must be positive
-    
-  if (fabs(tempDiff) >= 0.2) {
-    Serial.print(F("SCD30: adjusting temperature offset from "));
-    Serial.print(airsensor.getTemperatureOffset());
-    Serial.print(" to ");
-    Serial.print(tempOffset);
-    dtostrf(tempOffset, 5, 2, s1);
-    dtostrf(airsensor.getTemperatureOffset(), 5, 2, s2);
-    sprintf(buf, "scd30 temperature offset %s -> %s", removeSpaces(s2), removeSpaces(s1));
-    if (!airsensor.setTemperatureOffset(tempOffset)) {
-      Serial.print(F(" [FAILED]"));
-      strcat(buf, " failed");
-    }
-    Serial.println();
-    logMsg(buf);
-  
-  } else {
-    dtostrf(airsensor.getTemperatureOffset(), 5, 2, s1);
-    Serial.printf("SCD30: no temperature offset change, keeping %s\n", removeSpaces(s1));
-  }
+  scd30Fresh = false;
+  bme280Fresh = false;
+  selfheat_learn(scd30_rawTemperature - bme280_temperature);
 }
 
 
@@ -355,9 +458,9 @@ void scd30_adjustTempOffset() {
 // to fresh air (outside); if sensor readings are stable it's 
 // set to SCD30_CO2_CALIBRATION_VALUE as new baseline value
 void scd30_calibrate(uint16_t timeoutSecs) {
-  static char buf[64], s[8];
+  static char buf[80], s[8], d[8];
   static uint16_t prevCheckSecs = millis()/1000;
-  static double stddev;
+  bool stable, fresh;
 
   if (!scd30Init) {
     Serial.println(F("SCD30: not initialized!"));
@@ -367,10 +470,13 @@ void scd30_calibrate(uint16_t timeoutSecs) {
   if (co2status != CALIBRATE) {
     co2status = CALIBRATE;
     scd30_calibrate_countdown = timeoutSecs;
-    scd30_co2_calibrate.clear();
+    prevCheckSecs = millis()/1000;
+    stability_reset();
+    trend_reset();
+    ventilation_reset();
+    kalman_reset();
     scd30_readings(true);
-    stddev = UCHAR_MAX;
-    airsensor.setMeasurementInterval(2); // max. SCD30 reading interval
+    airsensor.setMeasurementInterval(SCD30_CALIBRATION_INTERVAL_SECS);
     Serial.print(F("SCD30: start calibration for "));
     Serial.print(timeoutSecs);
     Serial.print(F(" secs with target value "));
@@ -384,38 +490,48 @@ void scd30_calibrate(uint16_t timeoutSecs) {
     scd30_calibrate_countdown -= (millis()/1000 - prevCheckSecs);
     prevCheckSecs = millis()/1000;
 
-    // add new reading to running median every 10 secs
-    // and calculate standard deviation
-    if (scd30_calibrate_countdown % 10 <= 1) {
-      scd30_readings(true);
-      // start calculating standard deviation after 2 min.
-      if (scd30_co2_calibrate.getCount() >= 12)
-        stddev = stdDev(scd30_co2_calibrate, true);
-      dtostrf(stddev, 5, 2, s);
-    }
+    // use every reading, scd30_readings() adds it to the stability
+    // detector; finished as soon as both noise and drift are proven
+    // to be low (upper 95% confidence bounds); without new readings
+    // only the timeout is checked
+    fresh = airsensor.dataAvailable() && scd30_readings(true);
+    if (!fresh && scd30_calibrate_countdown > 0)
+      return;
+    stable = fresh && stability_check(SCD30_CALIBRATION_INTERVAL_SECS,
+      SCD30_CALIBRATION_SIGMA_MAX, SCD30_CALIBRATION_DRIFT_MAX);
+    fmt_fixed(s, min(stability_sigma(), uint32_t(99999)), 2, 2);
+    fmt_fixed(d, min(stability_drift(), uint32_t(99999)), 2, 2);
+#ifdef SCD30_DEBUG
+    if (stability_ready())
+      Serial.printf("SCD30: calibration sigma %s, drift %s ppm/min\n", s, d);
+#endif
 
-    // didn't stable reading within given timeout => exit with status FAILURE
-    if ((scd30_calibrate_countdown <= 0) && (stddev > 3)) {
+    // no stable readings within given timeout => exit with status FAILURE
+    if ((scd30_calibrate_countdown <= 0) && !stable) {
       co2status = FAILURE;
       scd30_calibrate_countdown = 0;
-      airsensor.setMeasurementInterval(int(settings.co2ReadingInterval/2));
-      Serial.printf("SCD30: calibration timeout, standard deviation %s too high\n", removeSpaces(s));
-      sprintf(buf, "scd30 calibration timeout, sigma %s", removeSpaces(s));
+      airsensor.setMeasurementInterval(scd30_interval());
+      Serial.printf("SCD30: calibration timeout, sigma %s, drift %s ppm/min too high\n", s, d);
+      sprintf(buf, "scd30 calibration timeout, sigma %s, drift %s", s, d);
       logMsg(buf);
 
-    // running median is below standard deviation threshold => recalibrate sensor
-    } else if (stddev <= 3) {
+    // readings are stable => recalibrate sensor
+    } else if (stable) {
       scd30_calibrate_countdown = 0;
-      airsensor.setMeasurementInterval(int(settings.co2ReadingInterval/2));
+      airsensor.setMeasurementInterval(scd30_interval());
 
       if (airsensor.setForcedRecalibrationFactor(SCD30_CO2_CALIBRATION_VALUE)) {
         co2status = NODATA;
-        Serial.printf("SCD30: calibration successful, %dppm -> %dppm, sigma %s\n", 
-          int(scd30_co2_calibrate.getAverage()), SCD30_CO2_CALIBRATION_VALUE, removeSpaces(s));
-        sprintf(buf, "scd30 calibration ok, %dppm -> %dppm, sigma %s", 
-          int(scd30_co2_calibrate.getAverage()), SCD30_CO2_CALIBRATION_VALUE, removeSpaces(s));
+        Serial.printf("SCD30: calibration successful, %dppm -> %dppm, sigma %s, drift %s\n", 
+          stability_mean(), SCD30_CO2_CALIBRATION_VALUE, s, d);
+        sprintf(buf, "scd30 calibration ok, %dppm -> %dppm, sigma %s, drift %s", 
+          stability_mean(), SCD30_CO2_CALIBRATION_VALUE, s, d);
         logMsg(buf);
-        
+        kalman_reset();  // readings jump to new calibration
+#ifdef SCD30_AUTO_BASELINE
+        baseline_reset();
+#endif
+
       } else {
         co2status = FAILURE;
         Serial.println(F("SCD30: calibration failed!"));
@@ -440,15 +556,33 @@ bool scd30_softreset() {
 // set global pressure variable and print all
 // BME/BMP280 readings (temp, hum, pres) to console
 void bme280_readings(bool verbose) {
-  uint16_t pres;
+  float temp, hum, pres;
+  uint32_t start;
+
+  bme280Fresh = false;
+  if (!i2c_present(I2C_BME280))
+    return;
 
   if (!bme280Init)
     bme280_init();
 
-  bme280_pressure = int(bme.pres()/100); // global variable
-  bme280_temperature = bme.temp(BME280::TempUnit_Celsius);
+  if (!bme280_forced()) {
+    Serial.println(F("BME280: conversion failed"));
+    return;
+  }
+
+  // read all compensated values in a single burst
+  start = i2c_begin(I2C_BME280);
+  bme.read(pres, temp, hum, BME280::TempUnit_Celsius, BME280::PresUnit_hPa);
+  if (!i2c_end(I2C_BME280, start, !isnan(temp))) {
+    Serial.println(F("BME280: reading failed"));
+    return;
+  }
+  bme280_pressure = int(pres); // global variable
+  bme280_temperature = lroundf(temp * 100);
+  bme280Fresh = true;
   if (hasBME280)
-    bme280_humidity = int(bme.hum());
+    bme280_humidity = int(hum);
 
   if (!verbose)
     return;
@@ -461,12 +595,7 @@ void bme280_readings(bool verbose) {
     Serial.print(F("BMP280: "));
   }
   Serial.print(F("temp("));
-  Serial.print(bme280_temperature, 1);
-  bme280_temp_readings.add(bme280_temperature); // used for temp auto offset
-#ifdef SCD30_DEBUG
-  Serial.print(F("C), tempStdDev("));
-  Serial.print(stdDev(bme280_temp_readings, false));
-#endif  
+  Serial.print(bme280_temperature/100.0, 1);
   Serial.print(F("C), pres("));
   Serial.print(bme280_pressure);
   Serial.println(F("hPa)"));
@@ -15,17 +15,43 @@
 #include <BME280I2C.h>
 #include <Wire.h>
 #include <RunningMedian.h>
+#include "config.h"
 
 #define SCD30_CO2_CALIBRATION_VALUE 420
-#define SCD30_CALIBRATION_SECS 300
+#define SCD30_FRC_MIN_PPM 400  // valid range for forced recalibration
+#define SCD30_FRC_MAX_PPM 2000
+#define SCD30_CALIBRATION_SECS 300  // timeout
+#define SCD30_CALIBRATION_INTERVAL_SECS 2
 #define SCD30_TEMP_OFFSET 1.9
 #define SCD30_OFFSET_UPDATES_SECS 600
 #define SCD30_INTERVAL_MIN_SECS 5
 #define SCD30_INTERVAL_MAX_SECS 60 // see CD_AN_SCD30_Low_Power_Mode_D2.pdf
 #define SCD30_WARMUP_SECS 60
 #define SCD30_READING_TIMEOUT 90
+#define SCD30_LOWPOWER_INTERVAL_SECS 60  // CD_AN_SCD30_Low_Power_Mode_D2.pdf
+#define SCD30_LOWPOWER_SAMPLES_MEDIAN 3
+#define SCD30_LOWPOWER_WARMUP_SECS 180  // internal filter needs a few cycles to settle
+// standard deviation thresholds in 1/100 of the readings' unit
+#define SCD30_CALIBRATION_SIGMA_MAX 300  // 3 ppm
+#define SCD30_CALIBRATION_DRIFT_MAX 300  // 3 ppm/min
 #define CO2_LOWER_BOUND 350  // https://wiki.seeedstudio.com/Grove-CO2_Sensor/
 
+#ifndef BME280_OVERSAMPLING_TEMP
+#define BME280_OVERSAMPLING_TEMP BME280::OSR_X1
+#endif
+#ifndef BME280_OVERSAMPLING_HUM
+#define BME280_OVERSAMPLING_HUM BME280::OSR_X1
+#endif
+#ifndef BME280_OVERSAMPLING_PRES
+#define BME280_OVERSAMPLING_PRES BME280::OSR_X1
+#endif
+#ifndef BME280_FILTER
+#define BME280_FILTER BME280::Filter_Off
+#endif
+#define BME280_REG_STATUS 0xF3
+#define BME280_REG_CTRL_MEAS 0xF4
+#define BME280_CONVERSION_TIMEOUT_MS 100
+
 
 enum sensorStatus {
   NODATA,
@@ -39,12 +65,19 @@ enum sensorStatus {
   NOOP
 };
 
+// values are stored in EEPROM, keep order
+enum co2Filter {
+  CO2_FILTER_NONE,
+  CO2_FILTER_MEDIAN,
+  CO2_FILTER_KALMAN
+};
+
 extern uint16_t scd30_co2ppm;
-extern float scd30_temperature;
+extern int16_t scd30_temperature;  // centi-°C
 extern uint8_t scd30_humidity;
 extern int16_t scd30_calibrate_countdown;
 extern int16_t scd30_warmup_countdown;
-extern float bme280_temperature;
+extern int16_t bme280_temperature;  // centi-°C
 extern uint16_t bme280_pressure;
 extern uint8_t bme280_humidity;
 extern bool hasBME280;
@@ -54,15 +87,20 @@ extern char statusNames[9][10];
 extern BME280I2C bme;
 extern SCD30 airSensor;
 extern RunningMedian scd30_co2_readings;
+extern RunningMedian scd30_co2_lowpower;
 
 void sensors_init();
 uint16_t bme280_init();
 void bme280_readings(bool verbose);
 void scd30_init(uint16_t pressure);
 void scd30_sleep();
+void scd30_lowpower(bool enable);
+uint16_t scd30_interval();
+uint16_t scd30_warmup();
+uint16_t sensors_interval();
 bool scd30_readings(bool reset);
 void scd30_pressure(uint16_t pressure);
-void scd30_adjustTempOffset();
+void scd30_learnSelfHeating();
 void scd30_calibrate(uint16_t timeout);
 bool scd30_softreset();
 #endif
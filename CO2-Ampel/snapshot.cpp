@@ -0,0 +1,75 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "snapshot.h"
+#include "webserver.h"
+#include "utils.h"
+#include "rtc.h"
+#include "battery.h"
+#include "trend.h"
+#include "ventilation.h"
+
+snapshot_t snapshot;
+
+static char jsonCache[2][snapshotJSON::size];
+static uint32_t jsonVersion[2];
+
+
+// take a new snapshot of current readings and system status; this is
+// the only place (besides checkLowBat()) where the battery voltage is
+// sampled, so it's independent of the number of clients
+void snapshot_update() {
+  snapshot.status = co2status;
+  snapshot.co2ppm = scd30_co2ppm;
+  snapshot.temperature = bme280_temperature;
+  snapshot.humidity = bme280_humidity;
+  snapshot.pressure = bme280_pressure;
+  snapshot.vbat = getVBAT();
+  snapshot.soc = battery_soc(snapshot.vbat);
+  snapshot.runtime = battery_hours();
+  snapshot.trend = trend_ppmh();
+  snapshot.forecast = trend_minutes();
+  snapshot.ach = ventilation_ach();
+  snapshot.timestamp = rtc_now();
+  strncpy(snapshot.date, getDateString(), sizeof(snapshot.date)-1);
+  strncpy(snapshot.time, getTimeString(false), sizeof(snapshot.time)-1);
+  snapshot.version++;
+  webserver_notify(); // push new readings to web ui
+}
+
+
+// returns snapshot serialized as JSON for RESTful requests or
+// MQTT messages, cached until the next snapshot is taken
+const char* snapshot_json(jsonFormat format) {
+  bool mqtt = (format == JSON_MQTT);
+  bool readings = (format == JSON_REST && snapshot.status <= ALARM) ||
+    (format == JSON_MQTT && snapshot.status > WARMUP && snapshot.status <= ALARM);
+  bool battery = (snapshot.vbat > VBAT_CONNECTED_MV);
+
+  if (jsonVersion[format] == snapshot.version)
+    return jsonCache[format];
+
+  snapshotJSON::write(jsonCache[format],
+    json::maybe(systemID().c_str(), mqtt),
+    json::maybe(snapshot.timestamp, mqtt),  // readings might be queued
+    json::maybe(snapshot.co2ppm, readings),
+    json::maybe(snapshot.temperature, readings),
+    json::maybe(snapshot.humidity, readings && hasBME280),
+    json::maybe(snapshot.pressure, readings),
+    statusNames[snapshot.status],
+    int16_t(snapshot.vbat / 10),  // centi-volts, truncated
+    json::maybe(snapshot.soc, battery),
+    json::maybe(snapshot.runtime, battery && snapshot.runtime >= 0),
+    json::maybe(snapshot.trend, readings),
+    json::maybe(snapshot.forecast, readings && snapshot.forecast >= 0),
+    json::maybe(snapshot.ach, snapshot.ach >= 0));
+  jsonVersion[format] = snapshot.version;
+  return jsonCache[format];
+}
@@ -0,0 +1,72 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <Arduino.h>
+#include "sensors.h"
+#include "jsonwriter.h"
+
+enum jsonFormat {
+  JSON_REST,
+  JSON_MQTT
+};
+
+// system state as seen by web ui, REST, MQTT and LoRaWAN;
+// updated once per sampling cycle with snapshot_update()
+typedef struct {
+  uint32_t version;
+  sensorStatus status;
+  uint16_t co2ppm;
+  int16_t temperature;  // centi-°C
+  uint8_t humidity;
+  uint16_t pressure;
+  uint16_t vbat;  // mV
+  uint8_t soc;  // battery state of charge (%)
+  int16_t runtime;  // remaining battery runtime (hours), -1 if unknown
+  int16_t trend;  // CO2 trend (ppm/h)
+  int16_t forecast;  // minutes until next CO2 threshold, -1 if none
+  int16_t ach;  // air changes per hour * 10 of last ventilation, -1 if none
+  uint32_t timestamp;  // UTC epoch
+  char date[11];  // DD.MM.YYYY
+  char time[6];  // HH:MM
+} snapshot_t;
+
+namespace jsonkey {
+  JSON_KEY(device); JSON_KEY(ts); JSON_KEY(co2median); JSON_KEY(temperature);
+  JSON_KEY(humidity); JSON_KEY(pressure); JSON_KEY(co2status); JSON_KEY(vbat);
+  JSON_KEY(soc); JSON_KEY(runtime); JSON_KEY(trend); JSON_KEY(forecast);
+  JSON_KEY(ach);
+}
+
+// snapshot as JSON for RESTful API and MQTT (device and timestamp only)
+typedef json::Object<
+  json::Optional<jsonkey::device, json::Str<6>>,
+  json::Optional<jsonkey::ts, json::UInt32>,
+  json::Optional<jsonkey::co2median, json::UInt16>,
+  json::Optional<jsonkey::temperature, json::Fixed<2,2>>,
+  json::Optional<jsonkey::humidity, json::UInt8>,
+  json::Optional<jsonkey::pressure, json::UInt16>,
+  json::Field<jsonkey::co2status, json::Str<9>>,
+  json::Field<jsonkey::vbat, json::Fixed<2,2>>,
+  json::Optional<jsonkey::soc, json::UInt8>,
+  json::Optional<jsonkey::runtime, json::Int16>,
+  json::Optional<jsonkey::trend, json::Int16>,
+  json::Optional<jsonkey::forecast, json::Int16>,
+  json::Optional<jsonkey::ach, json::Fixed<1,1>>
+> snapshotJSON;
+
+extern snapshot_t snapshot;
+
+void snapshot_update();
+const char* snapshot_json(jsonFormat format);
+
+#endif
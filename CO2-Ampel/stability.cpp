@@ -0,0 +1,98 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "stability.h"
+
+// linear regression over a sliding window of the last samples with
+// running sums; readings are considered stable if upper confidence
+// bounds of both residual noise and slope are below given limits
+static uint16_t window[STABILITY_WINDOW];
+static uint8_t head = 0, count = 0;
+static int32_t sumY;
+static int64_t sumYY, sumTY;  // t = 0 for oldest sample
+static uint32_t sigmaUpper = UINT32_MAX, driftUpper = UINT32_MAX;  // 1/100 units (per min)
+
+
+void stability_reset() {
+  head = 0;
+  count = 0;
+  sumY = 0;
+  sumYY = 0;
+  sumTY = 0;
+  sigmaUpper = UINT32_MAX;
+  driftUpper = UINT32_MAX;
+}
+
+
+// O(1) update, oldest sample is dropped once window is full
+void stability_add(uint16_t value) {
+  uint16_t oldest;
+
+  if (count == STABILITY_WINDOW) {
+    oldest = window[head];
+    sumTY -= sumY - oldest;  // shift t of remaining samples by one
+    sumY -= oldest;
+    sumYY -= int64_t(oldest) * oldest;
+    count--;
+  }
+  window[head] = value;
+  head = (head + 1) % STABILITY_WINDOW;
+  sumTY += int64_t(count) * value;
+  sumY += value;
+  sumYY += int64_t(value) * value;
+  count++;
+}
+
+
+// returns true if window is full and upper bounds of sigma (1/100 units)
+// and drift (1/100 units per minute) are within limits
+bool stability_check(uint16_t intervalSecs, uint32_t sigmaMax, uint32_t driftMax) {
+  int64_t n = count, st, stt, sty, syy;
+  double slope, sse, var, seSlope;
+
+  if (count < STABILITY_WINDOW)
+    return false;
+
+  // sums of squares times n, exact in integers
+  st = n * (n - 1) / 2;
+  stt = n * ((n - 1) * n * (2 * n - 1) / 6) - st * st;
+  sty = n * sumTY - st * sumY;
+  syy = n * sumYY - int64_t(sumY) * sumY;
+
+  slope = double(sty) / stt;
+  sse = (syy - double(sty) * sty / stt) / n;
+  var = max(sse, 0.0) / (n - 2);
+  seSlope = sqrt(var * n / stt);
+
+  sigmaUpper = sqrt(var) * STABILITY_CHI2_FACTOR * 100;
+  driftUpper = (fabs(slope) + STABILITY_Z * seSlope) * 60 / intervalSecs * 100;
+  return sigmaUpper <= sigmaMax && driftUpper <= driftMax;
+}
+
+
+uint32_t stability_sigma() {
+  return sigmaUpper;
+}
+
+
+uint32_t stability_drift() {
+  return driftUpper;
+}
+
+
+uint16_t stability_mean() {
+  return count ? sumY / count : 0;
+}
+
+
+// true once bounds have been calculated
+bool stability_ready() {
+  return count == STABILITY_WINDOW;
+}
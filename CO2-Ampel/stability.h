@@ -0,0 +1,28 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _STABILITY_H
+#define _STABILITY_H
+
+#include <Arduino.h>
+
+#define STABILITY_WINDOW 30  // samples
+#define STABILITY_Z 1.645  // one-sided 95% bound for slope
+#define STABILITY_CHI2_FACTOR 1.286  // 95% upper bound for sigma, sqrt(28/16.93)
+
+void stability_reset();
+void stability_add(uint16_t value);
+bool stability_check(uint16_t intervalSecs, uint32_t sigmaMax, uint32_t driftMax);
+uint32_t stability_sigma();
+uint32_t stability_drift();
+uint16_t stability_mean();
+bool stability_ready();
+
+#endif
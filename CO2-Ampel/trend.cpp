@@ -0,0 +1,96 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "trend.h"
+#include "rtc.h"
+
+// linear trend of CO2 readings as level and slope updated with each
+// sample (Holt's double exponential smoothing, an exponentially
+// weighted least squares fit); residuals are clipped to a multiple
+// of their mean absolute deviation to ignore single outliers
+static int32_t level;  // ppm << 8
+static int32_t slope;  // (ppm << 16) per sec
+static int32_t mad;  // mean absolute deviation, ppm << 8
+static uint32_t lastSample;
+static uint16_t samples = 0;
+
+
+void trend_add(uint16_t co2ppm) {
+  int32_t pred, resid, limit;
+  uint32_t now = millis()/1000, dt;
+
+  if (!samples) {
+    level = int32_t(co2ppm) << 8;
+    slope = 0;
+    mad = TREND_CLIP_MIN_PPM << 8;
+    lastSample = now;
+    samples++;
+    return;
+  }
+
+  dt = (now > lastSample) ? now - lastSample : 1;
+  lastSample = now;
+  pred = level + ((slope * int32_t(dt)) >> 8);
+  resid = (int32_t(co2ppm) << 8) - pred;
+
+  // robust update, clipping is based on the residuals seen so far
+  limit = constrain(mad * TREND_CLIP_FACTOR, TREND_CLIP_MIN_PPM << 8, TREND_CLIP_MAX_PPM << 8);
+  resid = constrain(resid, -limit, limit);
+  mad += (abs(resid) - mad) >> TREND_MAD_SHIFT;
+
+  level = pred + (resid >> TREND_ALPHA_SHIFT);
+  slope += (resid << (8 - TREND_ALPHA_SHIFT - TREND_BETA_SHIFT)) / int32_t(dt);
+  if (samples < TREND_MIN_SAMPLES)
+    samples++;
+}
+
+
+// start over (e.g. after calibration)
+void trend_reset() {
+  samples = 0;
+}
+
+
+// current slope in ppm per hour
+int16_t trend_ppmh() {
+  int32_t ppmh;
+
+  if (samples < TREND_MIN_SAMPLES)
+    return 0;
+  ppmh = (int64_t(slope) * 3600) >> 16;
+  if (ppmh > INT16_MAX)
+    return INT16_MAX;
+  else if (ppmh < INT16_MIN)
+    return INT16_MIN;
+  return ppmh;
+}
+
+
+// minutes until CO2 concentration crosses the next threshold
+// if current trend continues, -1 if not rising or too far ahead
+int16_t trend_minutes() {
+  int32_t ppm = level >> 8, minutes;
+  int16_t ppmh = trend_ppmh();
+  uint16_t threshold;
+
+  if (samples < TREND_MIN_SAMPLES || ppmh < TREND_MIN_SLOPE_PPMH)
+    return -1;
+  if (ppm < settings.co2MediumThreshold)
+    threshold = settings.co2MediumThreshold;
+  else if (ppm < settings.co2HighThreshold)
+    threshold = settings.co2HighThreshold;
+  else if (ppm < settings.co2AlarmThreshold)
+    threshold = settings.co2AlarmThreshold;
+  else
+    return -1;
+
+  minutes = (threshold - ppm) * 60 / ppmh;
+  return (minutes <= TREND_FORECAST_MAX_MINS) ? minutes : -1;
+}
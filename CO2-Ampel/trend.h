@@ -0,0 +1,31 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _TREND_H
+#define _TREND_H
+
+#include <Arduino.h>
+
+#define TREND_ALPHA_SHIFT 2  // level gain 1/4
+#define TREND_BETA_SHIFT 4  // slope gain 1/16 of level gain
+#define TREND_MAD_SHIFT 3  // mean absolute deviation over ~8 samples
+#define TREND_CLIP_FACTOR 3  // residuals clipped to 3x mean absolute deviation
+#define TREND_CLIP_MIN_PPM 20
+#define TREND_CLIP_MAX_PPM 500
+#define TREND_MIN_SAMPLES 10
+#define TREND_MIN_SLOPE_PPMH 60  // no forecast for slower increase
+#define TREND_FORECAST_MAX_MINS 240
+
+void trend_add(uint16_t co2ppm);
+void trend_reset();
+int16_t trend_ppmh();
+int16_t trend_minutes();
+
+#endif
@@ -10,15 +10,23 @@
 
 #include "config.h"
 #include "utils.h"
+#include "format.h"
 #include "lorawan.h"
 #include "led.h"
 #include "logging.h"
 #include "rtc.h"
 #include "wifi.h"
 #include "mqtt.h"
+#include "resume.h"
+#include "exposure.h"
+#include "baseline.h"
+#include "selfheat.h"
+#include "fixedpoint.h"
 
-RunningMedian vbat_readings = RunningMedian(10);
+RunningMedian vbat_readings = RunningMedian(VBAT_SAMPLES_MEDIAN);
 
+static bootphase_t bootPhases[BOOT_PHASES_MAX];
+static uint8_t numBootPhases = 0;
 rstcodes runmode;
 char runmodes[7][10] = {
   "reset",
@@ -31,27 +39,27 @@ char runmodes[7][10] = {
 };
 
 
-// returns the current battery voltage
-static float readBatteryVoltage() {
-  uint16_t raw = 0;
-  float vbat;
+// returns the current battery voltage (mV)
+static uint16_t readBatteryVoltage() {
+  uint32_t raw = 0;
+  uint16_t vbat;
 
   analogRead(A0);
   for (uint8_t i = 0; i < 10; i++) {
     raw += analogRead(A0);
     delay(1);
   }
-  vbat = (raw/10.0*VBAT_ADJUST)/1024.0;
-  if (vbat >= 2.0)
+  vbat = adc_vbat_mv(raw, 10);
+  if (vbat >= VBAT_CONNECTED_MV)
     return vbat;
   else
-    return 0.0;
+    return 0;
 }
 
 
-// returns running median value
-float getVBAT() {  
-  float vbat;
+// returns running median value (mV)
+uint16_t getVBAT() {
+  uint16_t vbat;
 
   vbat = readBatteryVoltage();
   vbat_readings.add(vbat);
@@ -67,47 +75,81 @@ float getVBAT() {
 // check battery voltage
 void checkLowBat() {
   static char buf[32], vbatStr[6];
-  float vbat;
+  uint16_t vbat;
 
   vbat = getVBAT();
-  if (vbat <= 2.0) {
+  if (vbat <= VBAT_CONNECTED_MV) {
     Serial.println(F("Battery not connected."));
-  } else if (vbat <= VBAT_DEEPSLEEP) {
+  } else if (vbat <= VBAT_DEEPSLEEP_MV) {
     blink_leds(QUARTER_RING, RED, 100, 6, false);
-    dtostrf(vbat, 4, 2, vbatStr);
+    fmt_fixed(vbatStr, vbat, 3, 2);
     Serial.printf("WARNING: low battery %sV, enter deep sleep!\n", vbatStr);
     sprintf(buf, "low battery %sV", vbatStr);
     logMsg(buf);
     enterDeepSleep(3600);
   } else {
     Serial.print(F("Battery voltage: "));
-    Serial.println(vbat);
+    Serial.println(vbat/1000.0);
   }
 }
 
 
+// sleep for given secs, periods longer than DEEPSLEEP_MAX_SECS
+// are continued by continueDeepSleep() after each wake up
+static void deepSleep(uint32_t secs) {
+  uint32_t chain[2];
+
+  chain[0] = (secs > DEEPSLEEP_MAX_SECS) ? secs - DEEPSLEEP_MAX_SECS : 0;
+  chain[1] = crc16((uint8_t *) &chain[0], sizeof(chain[0]));
+  ESP.rtcUserMemoryWrite(RTCMEM_SLEEP_OFFSET, chain, sizeof(chain));
+  if (secs > DEEPSLEEP_MAX_SECS)
+    secs = DEEPSLEEP_MAX_SECS;
+
+  Serial.flush();
+  // keep RF disabled until the last period to save power
+  system_deep_sleep_set_option(chain[0] ? 4 : 2); // no RF recalibration after wake up
+  ESP.deepSleep(secs*1000000ULL);
+}
+
+
+// go back to sleep right after wake up if a chained
+// deep sleep period hasn't finished yet
+void continueDeepSleep() {
+  uint32_t chain[2];
+
+  if (!ESP.rtcUserMemoryRead(RTCMEM_SLEEP_OFFSET, chain, sizeof(chain)) ||
+      chain[1] != crc16((uint8_t *) &chain[0], sizeof(chain[0])) || !chain[0])
+    return;
+  Serial.printf("Continue sleeping for %d secs...\n", chain[0]);
+  deepSleep(chain[0]);
+}
+
+
 void enterDeepSleep(uint32_t secs) {
   char buf[32];
-  if (secs > 4200) // max. 71 minutes
-      secs = 4200;
-      
+
   saveGeneralSettings();
   saveWifiSettings();
   saveMQTTSettings();
+  saveExposure();
+  saveRollups();
+#ifdef SCD30_AUTO_BASELINE
+  saveBaseline();
+#endif
+  saveSelfheat();
 #ifdef HAS_LORAWAN_SHIELD
   if (lorawanSettings.enabled && lmic_ready())
     lmic_stop();
 #endif
   scd30_sleep();
+  resume_save(secs);
   Serial.printf("Sleeping for %d secs...\n", secs);
   sprintf(buf, "sleeping %d secs", secs);
   logMsg(buf);
   clear_leds(ALL_LEDS);
   delay(1000);
   blink_leds(HALF_RING, BLUE, 100, 2, false);
-  Serial.flush();
-  system_deep_sleep_set_option(2); // avoid RF recalibration after wake up
-  ESP.deepSleep(secs*1000000);
+  deepSleep(secs);
 }
 
 
@@ -115,6 +157,12 @@ void resetSystem() {
   clear_leds(ALL_LEDS);
   Serial.println(F("Restarting system..."));
   logMsg("reset");
+  saveExposure();
+  saveRollups();
+#ifdef SCD30_AUTO_BASELINE
+  saveBaseline();
+#endif
+  saveSelfheat();
   delay(1000);
   blink_leds(HALF_RING, RED, 100, 2, false);
   Serial.flush();
@@ -122,99 +170,67 @@ void resetSystem() {
 }
 
 
-bool checkNOOPTime(uint8_t begin_hour, uint8_t end_hour) {
-  static char buf[64];
-  bool noop_time = false;
-  uint32_t epochTime;
-  DateTime now;
-  time_t t;
-
-  if (!settings.enableNOOP)
-      return false;
+// checksum for EEPROM
+uint16_t crc16(const uint8_t *data, uint8_t len) {
+  uint8_t x;
+  uint16_t crc = 0xFFFF;
 
-  if (rtcOK) {
-    now = rtc.now();
-    epochTime = now.unixtime(); 
-  }
-  t = CE.toLocal(epochTime);
-  
-  // either disabled or abort due to unvalid RTC time
-  if (begin_hour == end_hour || year(t) < 2020)
-    return false;
-  // check for valid configuration settings
-  if (begin_hour > 23 || begin_hour < 0 || end_hour > 23 || end_hour < 0)
-    return false;
-
-  if (begin_hour < end_hour) {
-    if (begin_hour <= hour(t) && hour(t) < end_hour)
-      noop_time = true;
-  } else if (begin_hour <= hour(t) || hour(t) < end_hour) {
-    noop_time = true;
+  while (len--) {
+    x = (crc >> 8) ^ *data++;
+    x ^= x >> 4;
+    crc = (crc << 8) ^ (x << 12) ^ (x << 5) ^ x;
   }
+  crc &= 0xffff;
+  return crc;
+}
 
-  if (noop_time && co2status != NOOP) {
-    co2status = NOOP;
-    Serial.printf("NOOP from %.2d:00 to %.2d:00\n", begin_hour, end_hour);
-    sprintf(buf, "noop %.2d:00-%.2d:00", begin_hour, end_hour);
-    logMsg(buf);
-  }
 
-  return noop_time;
+// record duration of a boot phase since the previous one
+void bootPhase(const char* name) {
+  static uint32_t prevMillis = 0;
+
+  if (numBootPhases >= BOOT_PHASES_MAX)
+    return;
+  bootPhases[numBootPhases].name = name;
+  bootPhases[numBootPhases].ms = millis() - prevMillis;
+  prevMillis = millis();
+  numBootPhases++;
 }
 
 
-// start and scan I2C for devices
-// return number of devices found
-uint8_t i2c_init() {
-  uint8_t addr, error, devices;
-  
-  Wire.begin();
-  Wire.setClock(100000); // see SCD30_Interface_Description.pdf (May 2020)
-  Wire.setClockStretchLimit(30000); // 30ms
-  devices = 0;
-  Serial.print(F("Scanning I2C bus..."));
-  for (addr = 1; addr < 127; addr++) {
-    Wire.beginTransmission(addr);
-    error = Wire.endTransmission();
-    if (error == 0) {
-      devices++;
-    } else if (error == 4) {
-      Serial.print("unknown error for address 0x");
-      if (addr < 16) 
-        Serial.print("0");
-      Serial.println(addr, HEX);
-      return 0;
-    }
-  }
-  Serial.printf("%d devices found.\n", devices);
-  return devices;
+// print and log duration of all boot phases
+void bootSummary() {
+  char buf[32];
+
+  Serial.print(F("Boot phases:"));
+  for (uint8_t i = 0; i < numBootPhases; i++)
+    Serial.printf(" %s %ums%s", bootPhases[i].name, bootPhases[i].ms, (i < numBootPhases-1) ? "," : "");
+  Serial.printf("; total %ums\n", bootTime());
+  sprintf(buf, "boot %ums", bootTime());
+  logMsg(buf);
 }
 
 
-// returns given string without spaces
-char* removeSpaces(char *str) {
-  uint8_t i = 0, j = 0;
-  while (str[i++]) {
-    if (str[i-1] != ' ')
-      str[j++] = str[i-1];
-  }
-  str[j] = '\0';
-  return str;
+// returns total boot time in ms
+uint32_t bootTime() {
+  uint32_t total = 0;
+
+  for (uint8_t i = 0; i < numBootPhases; i++)
+    total += bootPhases[i].ms;
+  return total;
 }
 
 
-// checksum for EEPROM
-uint16_t crc16(const uint8_t *data, uint8_t len) {
-  uint8_t x;
-  uint16_t crc = 0xFFFF;
+// returns boot phases as string 'name=ms;name=ms;...' for web ui
+String bootProfile() {
+  String profile;
 
-  while (len--) {
-    x = (crc >> 8) ^ *data++;
-    x ^= x >> 4;
-    crc = (crc << 8) ^ (x << 12) ^ (x << 5) ^ x;
+  for (uint8_t i = 0; i < numBootPhases; i++) {
+    if (i)
+      profile += ";";
+    profile += String(bootPhases[i].name) + "=" + String(bootPhases[i].ms);
   }
-  crc &= 0xffff;
-  return crc;
+  return profile;
 }
 
 
@@ -260,7 +276,6 @@ void bootMessage() {
     runmode = OTHER;
   }
   Serial.println();
-  delay(1000);
 }
 
 
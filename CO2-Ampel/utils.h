@@ -22,7 +22,17 @@ extern "C" {
 
 // if battery voltage falls below this level
 // resort to deep sleep to protect batteries
-#define VBAT_DEEPSLEEP 3.55
+#define VBAT_DEEPSLEEP_MV 3550
+#define VBAT_CONNECTED_MV 2000  // lower readings: no battery connected
+#define VBAT_SAMPLES_MEDIAN 10
+
+// longer deep sleep periods are chained, remaining
+// time is kept in RTC user memory (first 128 bytes
+// are reserved for OTA updates)
+#define DEEPSLEEP_MAX_SECS 4200  // max. 71 minutes
+#define RTCMEM_SLEEP_OFFSET 32
+
+#define BOOT_PHASES_MAX 12
 
 enum rstcodes {
   RESET,
@@ -34,19 +44,27 @@ enum rstcodes {
   OTHER
 };
 
+typedef struct {
+  const char* name;
+  uint32_t ms;
+} bootphase_t;
+
 extern rstcodes runmode;
+extern RunningMedian vbat_readings;
 extern char runmodes[7][10];
 
 void bootMessage();
-uint8_t i2c_init();
+void bootPhase(const char* name);
+void bootSummary();
+uint32_t bootTime();
+String bootProfile();
 void checkLowBat();
-float getVBAT();
-bool checkNOOPTime(uint8_t begin_hour, uint8_t end_hour);
+uint16_t getVBAT();
 char* getRuntime(uint32_t runtimeSecs);
 uint16_t crc16(const uint8_t *data, uint8_t len);
-char* removeSpaces(char *str);
 String systemID();
 void enterDeepSleep(uint32_t secs);
+void continueDeepSleep();
 void resetSystem();
 char* lowercase(char* s);
 #ifdef HAS_LORAWAN_SHIELD
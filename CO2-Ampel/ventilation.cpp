@@ -0,0 +1,175 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "ventilation.h"
+#include "logging.h"
+#include "format.h"
+
+// mass balance dC/dt = G - ach * (C - outdoor), integrated since the
+// peak: C - Cpeak = a + G * t - ach * I with I = integral of (C - outdoor);
+// a least squares fit of a, G and ach needs only running sums, and
+// CO2 emitted by people during the ventilation does not bias ach;
+// sums are kept in 64 bit integers (t in secs, I in ppm * secs), which
+// can't overflow within VENT_MAX_SECS, only the solution needs floats
+typedef struct {
+  uint16_t n;
+  int64_t t, i, y, tt, ii, ti, ty, iy;
+} decayfit_t;
+
+static decayfit_t fit, fitAtMin;
+static bool active = false;
+static uint16_t peakPPM = 0, minPPM, lastPPM;
+static uint32_t peakSecs, minSecs, lastSecs;
+static int32_t integral;  // ppm * secs
+static ventilation_t lastEvent;
+static bool hasEvent = false;
+
+
+// start over from given reading as new peak
+static void newPeak(uint16_t co2ppm, uint32_t now) {
+  peakPPM = co2ppm;
+  peakSecs = now;
+  minPPM = co2ppm;
+  minSecs = now;
+  lastPPM = co2ppm;
+  lastSecs = now;
+  integral = 0;
+  memset(&fit, 0, sizeof(fit));
+  memset(&fitAtMin, 0, sizeof(fitAtMin));
+}
+
+
+static void addSample(uint16_t co2ppm, uint32_t now) {
+  int64_t t = now - peakSecs, y = int32_t(co2ppm) - peakPPM, i;
+
+  integral += (int32_t(co2ppm + lastPPM) - 2 * VENT_OUTDOOR_PPM) * int32_t(now - lastSecs) / 2;
+  i = integral;
+  lastPPM = co2ppm;
+  lastSecs = now;
+  fit.n++;
+  fit.t += t;
+  fit.i += i;
+  fit.y += y;
+  fit.tt += t * t;
+  fit.ii += i * i;
+  fit.ti += t * i;
+  fit.ty += t * y;
+  fit.iy += i * y;
+}
+
+
+static double det3(double a, double b, double c, double d, double e, double f,
+    double g, double h, double i) {
+  return a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+}
+
+
+// fits decay up to the lowest reading, logs event if the drop
+// was large enough and sets air changes per hour
+static void finishEvent() {
+  const decayfit_t &f = fitAtMin;
+  double d, ach;
+  char buf[64];
+  char *p;
+
+  active = false;
+  if (peakPPM - minPPM < VENT_MIN_DROP_PPM || f.n < VENT_MIN_SAMPLES)
+    return;
+
+  // solve normal equations with Cramer's rule
+  d = det3(f.n, f.t, f.i, f.t, f.tt, f.ti, f.i, f.ti, f.ii);
+  if (d == 0)
+    return;
+  ach = -det3(f.n, f.t, f.y, f.t, f.tt, f.ty, f.i, f.ti, f.iy) / d * 3600;  // per hour
+  if (ach <= 0)
+    return;
+
+  lastEvent.duration = minSecs - peakSecs;
+  lastEvent.startPPM = peakPPM;
+  lastEvent.endPPM = minPPM;
+  lastEvent.ach = min(ach * 10, double(INT16_MAX));
+  hasEvent = true;
+
+  p = buf + sprintf(buf, "ventilation %lumin, %u->%uppm, ",
+    (unsigned long)(lastEvent.duration / 60), lastEvent.startPPM, lastEvent.endPPM);
+  p = fmt_fixed(p, lastEvent.ach, 1, 1);
+  strcpy(p, "ach");
+  Serial.print(F("VENT: "));
+  Serial.println(buf);
+  logMsg(buf);
+}
+
+
+// tracks the last CO2 peak, a drop of more than VENT_START_DROP_PPM
+// starts a ventilation which lasts until the concentration rises
+// again or stalls; runs in constant time and memory per reading
+void ventilation_add(uint16_t co2ppm) {
+  uint32_t now = millis()/1000;
+
+  if (!peakPPM) {
+    newPeak(co2ppm, now);
+    addSample(co2ppm, now);
+    return;
+  }
+
+  if (!active) {
+    if (co2ppm >= peakPPM || (now - peakSecs) > VENT_ONSET_SECS) {
+      newPeak(co2ppm, now);
+      addSample(co2ppm, now);
+      return;
+    }
+    addSample(co2ppm, now);
+    if (co2ppm < minPPM) {
+      minPPM = co2ppm;
+      minSecs = now;
+      fitAtMin = fit;
+    }
+    if (peakPPM - co2ppm >= VENT_START_DROP_PPM) {
+      active = true;
+      Serial.printf("VENT: ventilation detected, %uppm -> %uppm\n", peakPPM, co2ppm);
+    }
+    return;
+  }
+
+  // slow decline after closing the windows of an empty room
+  // is not counted as progress, otherwise the fit would mix
+  // both air change rates and the event would last for ages
+  addSample(co2ppm, now);
+  if (co2ppm + VENT_STALL_PPM <= minPPM) {
+    minPPM = co2ppm;
+    minSecs = now;
+    fitAtMin = fit;
+  }
+
+  if (co2ppm > minPPM + VENT_END_RISE_PPM || (now - minSecs) > VENT_STALL_SECS ||
+      (now - peakSecs) > VENT_MAX_SECS) {
+    finishEvent();
+    newPeak(co2ppm, now);
+    addSample(co2ppm, now);
+  }
+}
+
+
+// drop current event (e.g. on calibration)
+void ventilation_reset() {
+  active = false;
+  peakPPM = 0;
+}
+
+
+// air changes per hour * 10 of last ventilation, -1 if none yet
+int16_t ventilation_ach() {
+  return hasEvent ? lastEvent.ach : -1;
+}
+
+
+const ventilation_t* ventilation_last() {
+  return hasEvent ? &lastEvent : NULL;
+}
@@ -0,0 +1,38 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _VENTILATION_H
+#define _VENTILATION_H
+
+#include <Arduino.h>
+
+#define VENT_OUTDOOR_PPM 420  // CO2 concentration of fresh air (for scaling only)
+#define VENT_START_DROP_PPM 100  // drop from peak to detect ventilation
+#define VENT_ONSET_SECS 600  // max. time from peak to detected drop
+#define VENT_END_RISE_PPM 40  // rise above minimum ends ventilation
+#define VENT_STALL_SECS 300  // no new minimum ends ventilation
+#define VENT_STALL_PPM 10  // min. decline for a new minimum
+#define VENT_MAX_SECS 7200
+#define VENT_MIN_SAMPLES 5
+#define VENT_MIN_DROP_PPM 150  // smaller drops are not logged
+
+typedef struct {
+  uint32_t duration;  // secs
+  uint16_t startPPM;
+  uint16_t endPPM;
+  uint16_t ach;  // air changes per hour * 10
+} ventilation_t;
+
+void ventilation_add(uint16_t co2ppm);
+void ventilation_reset();
+int16_t ventilation_ach();
+const ventilation_t* ventilation_last();
+
+#endif
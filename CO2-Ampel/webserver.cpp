@@ -9,13 +9,18 @@
 ***************************************************************************/
 
 #include "webserver.h"
+#include "format.h"
 #include "lorawan.h"
 #include "logging.h"
 #include "utils.h"
 #include "led.h"
 #include "rtc.h"
+#include "scheduler.h"
 #include "mqtt.h"
 #include "sensors.h"
+#include "snapshot.h"
+#include "exposure.h"
+#include "stability.h"
 #include "wifi.h"
 #include "config.h"
 
@@ -28,6 +33,9 @@
 ESP8266WebServer webserver(80);
 static uint32_t webserverRequestMillis = 0;
 static uint16_t webserverTimeout = 0;
+static uint32_t eventsVersion = 1;
+static WiFiClient eventClients[WEBSERVER_EVENT_CLIENTS];
+static uint32_t eventClientsVersion[WEBSERVER_EVENT_CLIENTS];
 
 
 static void requirePassword() {
@@ -52,70 +60,177 @@ static void sendCORS() {
 }
 
 
-// pass sensor readings, system status to web ui as JSON
-static void updateUI() {
-  StaticJsonDocument<320> JSON;
-  char reply[272], buf[16];
+namespace jsonkey {
+  JSON_KEY(date); JSON_KEY(time); JSON_KEY(batteryLife); JSON_KEY(webserverTimeout);
+  JSON_KEY(calibrationTimeout); JSON_KEY(calibrationSigma); JSON_KEY(calibrationDrift);
+  JSON_KEY(warmupTimeout); JSON_KEY(rssi);
+  JSON_KEY(mqttMessages); JSON_KEY(loraDevAddr); JSON_KEY(loraSeqnoUp); JSON_KEY(otaa);
+}
+
+typedef json::Object<
+  json::Field<jsonkey::date, json::Str<10>>,
+  json::Field<jsonkey::time, json::Str<5>>,
+  json::Field<jsonkey::temperature, json::Fixed<2,2>>,
+  json::Field<jsonkey::humidity, json::Raw<4>>,  // number or "--"
+  json::Field<jsonkey::pressure, json::UInt16>,
+  json::Field<jsonkey::co2median, json::UInt16>,
+  json::Field<jsonkey::trend, json::Int16>,
+  json::Field<jsonkey::forecast, json::Int16>,
+  json::Optional<jsonkey::ach, json::Fixed<1,1>>,
+  json::Field<jsonkey::vbat, json::Fixed<2,2>>,
+  json::Field<jsonkey::soc, json::UInt8>,
+  json::Field<jsonkey::batteryLife, json::Int16>,
+  json::Field<jsonkey::co2status, json::UInt8>,
+  json::Field<jsonkey::webserverTimeout, json::Int32>,
+  json::Field<jsonkey::calibrationTimeout, json::Int16>,
+  json::Optional<jsonkey::calibrationSigma, json::Fixed<2,1>>,  // upper bounds while calibrating
+  json::Optional<jsonkey::calibrationDrift, json::Fixed<2,1>>,
+  json::Field<jsonkey::warmupTimeout, json::Int16>,
+  json::Field<jsonkey::rssi, json::Int16>,
+  json::Field<jsonkey::mqttMessages, json::Int32>,
+  json::Optional<jsonkey::loraDevAddr, json::Str<8>>,
+  json::Optional<jsonkey::loraSeqnoUp, json::UInt32>,
+  json::Field<jsonkey::otaa, json::Int16>
+> uiSchema;
+
+
+// returns sensor readings and system status for web ui as JSON;
+// readings are taken from the system snapshot, the JSON string itself
+// is rebuilt at most once per second and thus shared by all browser tabs
+static const char* uiJSON() {
+  static uint32_t cachedVersion = 0, cachedSecs = 0;
+  static char reply[uiSchema::size];
+  char hum[5] = "\"--\"", devAddr[9] = "--------";
+  uint32_t seqnoUp = 0;
+  int16_t otaa = -1;
+  bool lora = false;
+  bool calibrating = (co2status == CALIBRATE && stability_ready());
+
+  if (cachedVersion == eventsVersion && cachedSecs == millis()/1000)
+    return reply;
+  cachedVersion = eventsVersion;
+  cachedSecs = millis()/1000;
 
-  JSON["date"] = getDateString();
-  JSON["time"] = getTimeString(false);
-  JSON["temperature"] = bme280_temperature;
   if (hasBME280)
-    JSON["humidity"] = bme280_humidity;
-  else
-    JSON["humidity"] = "--";
-  JSON["pressure"] = bme280_pressure;
-  JSON["co2median"] = scd30_co2ppm;
-  JSON["vbat"] = ((int)(getVBAT()*100)) / 100.0;
-  JSON["co2status"] = int(co2status);
-  if (wifiSettings.webserverAutoOff || co2status == NOOP)
-    JSON["webserverTimeout"] = (webserverTimeout*1000 - (millis()-webserverRequestMillis))/1000;
-  else
-    JSON["webserverTimeout"] = -1;
-  JSON["calibrationTimeout"] = scd30_calibrate_countdown;
-  JSON["warmupTimeout"] = scd30_warmup_countdown;
-  if (mqttSettings.enabled)
-    JSON["mqttMessages"] = mqtt_messages();
-  else
-    JSON["mqttMessages"] = -1;
+    fmt_uint(hum, snapshot.humidity);
 #ifdef HAS_LORAWAN_SHIELD
+  lora = true;
   if (lorawanSettings.enabled && lorawanSession.lmic.devaddr > 0) {
-    sprintf(buf, "%08X", lorawanSession.lmic.devaddr);
-    JSON["loraDevAddr"] = buf;
-    JSON["loraSeqnoUp"] = lorawanSession.lmic.seqnoUp+1;
-  } else {
-    JSON["loraDevAddr"] = "--------";
-    JSON["loraSeqnoUp"] = 0;
+    sprintf(devAddr, "%08X", lorawanSession.lmic.devaddr);
+    seqnoUp = lorawanSession.lmic.seqnoUp+1;
   }
+  if (lorawanSettings.enabled)
+    otaa = lorawanSettings.useOTAA;
 #endif
-#ifdef HAS_LORAWAN_SHIELD
-  JSON["otaa"] = lorawanSettings.enabled ? int(lorawanSettings.useOTAA) : -1;
-#else
-  JSON["otaa"] = -1;
-#endif
-  serializeJson(JSON, reply);
-  webserver.send(200, F("application/json"), reply);
+
+  uiSchema::write(reply,
+    snapshot.date,
+    snapshot.time,
+    snapshot.temperature,
+    hum,
+    snapshot.pressure,
+    snapshot.co2ppm,
+    snapshot.trend,
+    snapshot.forecast,
+    json::maybe(snapshot.ach, snapshot.ach >= 0),
+    int16_t(snapshot.vbat / 10),  // centi-volts, truncated
+    snapshot.soc,
+    snapshot.runtime,
+    co2status,
+    (wifiSettings.webserverAutoOff || co2status == NOOP) ?
+      int32_t(webserverTimeout*1000 - (millis()-webserverRequestMillis))/1000 : -1,
+    scd30_calibrate_countdown,
+    json::maybe(int16_t(min(stability_sigma(), uint32_t(INT16_MAX))), calibrating),
+    json::maybe(int16_t(min(stability_drift(), uint32_t(INT16_MAX))), calibrating),
+    scd30_warmup_countdown,
+    wifi_rssi(),
+    mqttSettings.enabled ? int32_t(mqtt_messages()) : -1,
+    json::maybe<const char*>(devAddr, lora),
+    json::maybe(seqnoUp, lora),
+    otaa);
+  return reply;
+}
+
+
+// pass sensor readings, system status to web ui as JSON
+static void updateUI() {
+  webserver.send(200, F("application/json"), uiJSON());
+}
+
+
+// subscribe browser to event stream on /events; readings are pushed
+// by webserver_events() instead of being polled every few seconds
+static void handleEvents() {
+  WiFiClient client = webserver.client();
+  uint8_t i;
+
+  for (i = 0; i < WEBSERVER_EVENT_CLIENTS; i++) {
+    if (!eventClients[i].connected())
+      break;
+  }
+  if (i == WEBSERVER_EVENT_CLIENTS) {
+    webserver.send(503, "text/plain", "Error 503: too many clients");
+    return;
+  }
+
+  client.setNoDelay(true);
+  client.print(F("HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "Access-Control-Allow-Origin: *\r\n\r\n"));
+  eventClients[i] = client; // keep connection after handler returns
+  eventClientsVersion[i] = 0;
+  Serial.printf("Webserver: event stream client %d connected.\n", i+1);
 }
 
 
 // send sensor readings on RESTful request on /readings
 static void handleREST() {
-  StaticJsonDocument<128> JSON;
-  char reply[128];
+  setCrossOrigin();
+  webserver.send(200, F("application/json"), snapshot_json(JSON_REST));
+}
+
+
+// send exposure of current and last hour, day and week on /exposure;
+// sent in chunks to keep the JSON string out of RAM
+static void handleExposure() {
+  char buf[exposureJSON::size + 16];
+  char json[exposureJSON::size];
+  uint8_t w;
 
   setCrossOrigin();
-  if (co2status <= ALARM) {
-    JSON["co2median"] = scd30_co2ppm;
-    JSON["temperature"] = bme280_temperature;
-    if (hasBME280)
-      JSON["humidity"] = bme280_humidity;
-    JSON["pressure"] = bme280_pressure;
+  webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  webserver.send(200, F("application/json"), "");
+  sprintf(buf, "{\"device\":\"%s\"", systemID().c_str());
+  webserver.sendContent(buf);
+  for (w = EXPOSURE_HOUR; w <= EXPOSURE_WEEK; w++) {
+    for (uint8_t last = 0; last <= 1; last++) {
+      exposure_json(exposureWindow(w), last, json);
+      sprintf(buf, ",\"%s\":%s", exposure_name(exposureWindow(w), last), json);
+      webserver.sendContent(buf);
+    }
   }
-  JSON["vbat"] = ((int)(getVBAT()*100)) / 100.0;
-  JSON["co2status"] = statusNames[co2status];
+  webserver.sendContent("}");
+  webserver.sendContent("");  // end of chunked transfer
+}
+
+
+// true if the posted network settings have valid credentials for
+// the primary or at least one alternative network (which may be open)
+static bool staCredentials() {
+  String ssid, pass;
 
-  serializeJson(JSON, reply);
-  webserver.send(200, F("application/json"), reply);
+  if (webserver.arg("stassid").length() > 2 && webserver.arg("stapassword").length() >= 8)
+    return true;
+  for (uint8_t i = 1; i < WIFI_STA_NETWORKS; i++) {
+    ssid = webserver.arg("stassid" + String(i));
+    pass = webserver.arg("stapassword" + String(i));
+    if (ssid.length() > 2 && ssid.length() <= 31 &&
+        (!pass.length() || (pass.length() >= 8 && pass.length() <= 31)))
+      return true;
+  }
+  return false;
 }
 
 
@@ -144,10 +259,15 @@ void webserver_start(uint16_t timeout) {
   // AJAX request from main page to update readings
   webserver.on("/ui", HTTP_GET, updateUI);
 
+  // event stream for main page, pushes readings on changes
+  webserver.on("/events", HTTP_GET, handleEvents);
+
   // handle RESTful requests
   if (wifiSettings.enableREST) {
     webserver.on(F("/readings"), HTTP_OPTIONS, sendCORS);
     webserver.on(F("/readings"), HTTP_GET, handleREST);
+    webserver.on(F("/exposure"), HTTP_OPTIONS, sendCORS);
+    webserver.on(F("/exposure"), HTTP_GET, handleExposure);
   }
 
   // show page with log files
@@ -203,7 +323,8 @@ void webserver_start(uint16_t timeout) {
 #else
     html += "0,";
 #endif
-    html += settings.enableLogging ? "1" : "0";
+    html += settings.enableLogging ? "1," : "0,";
+    html += String(bootTime()) + "," + bootProfile();
     webserver.send(200, "text/html", html);
   });
 
@@ -343,10 +464,11 @@ void webserver_start(uint16_t timeout) {
       html.replace("__LOGGING__", "checked");
     else
       html.replace("__LOGGING__", "");
-    if (settings.medianFilter)
-      html.replace("__MEDIANFILTER__", "checked");
+    html.replace("__CO2FILTER__", String(settings.co2Filter));
+    if (powerSettings.lowPower)
+      html.replace("__LOWPOWER__", "checked");
     else
-      html.replace("__MEDIANFILTER__", "");
+      html.replace("__LOWPOWER__", "");
 
     webserver.send(200, "text/html", html);
     Serial.println(F("Show general settings."));
@@ -389,10 +511,13 @@ void webserver_start(uint16_t timeout) {
     if (webserver.arg("loginterval").toInt() >= 60 && webserver.arg("loginterval").toInt() <= 900)
       settings.loggingInterval = webserver.arg("loginterval").toInt();
 
-    if (webserver.arg("medianfilter") == "on")
-      settings.medianFilter = true;
-    else
-      settings.medianFilter = false; 
+    if (webserver.arg("co2filter").toInt() >= CO2_FILTER_NONE &&
+        webserver.arg("co2filter").toInt() <= CO2_FILTER_KALMAN)
+      settings.co2Filter = webserver.arg("co2filter").toInt();
+    if ((webserver.arg("lowpower") == "on") != powerSettings.lowPower) {
+      scd30_lowpower(webserver.arg("lowpower") == "on");
+      wifi_powersave();
+    }
     if (webserver.arg("noop") == "on") {
       settings.enableNOOP = true;
       if (checkNOOPTime(settings.beginSleep, settings.endSleep))
@@ -434,6 +559,10 @@ void webserver_start(uint16_t timeout) {
     html.replace("__WEBTIMEOUTMIN__", String(WEBSERVER_TIMEOUT_MIN_SECS));
     html.replace("__STASSID__", String(wifiSettings.wifiStaSSID));
     html.replace("__STAPASSWORD__", String(wifiSettings.wifiStaPassword));
+    for (uint8_t i = 1; i < WIFI_STA_NETWORKS; i++) {
+      html.replace("__STASSID" + String(i) + "__", String(wifiNetworks.alt[i-1].ssid));
+      html.replace("__STAPASSWORD" + String(i) + "__", String(wifiNetworks.alt[i-1].password));
+    }
     html.replace("__MQTTBROKER__", String(mqttSettings.broker));
     html.replace("__MQTTTOPIC__", String(mqttSettings.topic));
     html.replace("__MQTTUSERNAME__", String(mqttSettings.username));
@@ -485,6 +614,16 @@ void webserver_start(uint16_t timeout) {
       strncpy(wifiSettings.wifiStaSSID, webserver.arg("stassid").c_str(), 31);
     if (webserver.arg("stapassword").length() >= 8 && webserver.arg("stapassword").length() <= 31)
       strncpy(wifiSettings.wifiStaPassword, webserver.arg("stapassword").c_str(), 31);  
+    for (uint8_t i = 1; i < WIFI_STA_NETWORKS; i++) {  // empty SSID removes network
+      String ssid = webserver.arg("stassid" + String(i));
+      String pass = webserver.arg("stapassword" + String(i));
+      if (ssid.length() <= 31 && (!pass.length() || (pass.length() >= 8 && pass.length() <= 31)) &&
+          (strcmp(ssid.c_str(), wifiNetworks.alt[i-1].ssid) || strcmp(pass.c_str(), wifiNetworks.alt[i-1].password))) {
+        strncpy(wifiNetworks.alt[i-1].ssid, ssid.c_str(), 31);
+        strncpy(wifiNetworks.alt[i-1].password, pass.c_str(), 31);
+        wifiNetworks.score[i] = 0;  // new credentials
+      }
+    }
     if (webserver.arg("mqttbroker").length() >= 4 && webserver.arg("mqttbroker").length() <= 63)
       strncpy(mqttSettings.broker, webserver.arg("mqttbroker").c_str(), 63);
     if (webserver.arg("mqtttopic").length() >= 4 && webserver.arg("mqttbroker").length() <= 63)
@@ -526,7 +665,7 @@ void webserver_start(uint16_t timeout) {
       mqttSettings.enableJSON = true;
 
     // sanity checks
-    if (webserver.arg("stassid").length() <= 2 || webserver.arg("stapassword").length() < 8) {
+    if (!staCredentials()) {
       wifiSettings.enableREST = false;
       wifiSettings.enableWLANUplink = false;
       mqttSettings.enabled = false;
@@ -536,7 +675,7 @@ void webserver_start(uint16_t timeout) {
       mqttSettings.enabled = false;
     }
 
-    if (saveWifiSettings() && saveMQTTSettings())
+    if (saveWifiSettings() && saveWifiNetworks() && saveMQTTSettings())
       webserver.sendHeader("Location", "/network?saved", true);
     else
       webserver.sendHeader("Location", "/network?failed", true);
@@ -730,6 +869,8 @@ bool webserver_stop(bool force) {
     return false;
 
   if (webserverRequestMillis > 0) {
+    for (uint8_t i = 0; i < WEBSERVER_EVENT_CLIENTS; i++)
+      eventClients[i].stop();
     webserver.stop();
     webserverRequestMillis = 0;
     logMsg("webserver off");
@@ -737,3 +878,47 @@ bool webserver_stop(bool force) {
   }
   return true;
 }
+
+
+// signal new readings or status changes to web ui
+void webserver_notify() {
+  eventsVersion++;
+}
+
+
+// push cached readings to all event stream clients if snapshot or
+// countdowns have changed since the last push, otherwise send a
+// keep-alive comment every few seconds; call once per second
+void webserver_events() {
+  static int16_t prevWarmup, prevCalibrate;
+  static uint32_t prevKeepAlive = 0;
+  bool keepAlive = false;
+
+  if (!webserverRequestMillis)
+    return;
+
+  // countdowns also trigger an update
+  if (scd30_warmup_countdown != prevWarmup || scd30_calibrate_countdown != prevCalibrate) {
+    prevWarmup = scd30_warmup_countdown;
+    prevCalibrate = scd30_calibrate_countdown;
+    webserver_notify();
+  }
+
+  if (millis() - prevKeepAlive >= WEBSERVER_EVENT_KEEPALIVE_SECS*1000) {
+    prevKeepAlive = millis();
+    keepAlive = true;
+  }
+
+  for (uint8_t i = 0; i < WEBSERVER_EVENT_CLIENTS; i++) {
+    if (!eventClients[i].connected())
+      continue;
+    if (eventClientsVersion[i] != eventsVersion) {
+      eventClientsVersion[i] = eventsVersion;
+      eventClients[i].print(F("data: "));
+      eventClients[i].print(uiJSON());
+      eventClients[i].print(F("\n\n"));
+    } else if (keepAlive) {
+      eventClients[i].print(F(": keep-alive\n\n"));
+    }
+  }
+}
@@ -18,6 +18,8 @@
 #define WEBSERVER_TIMEOUT_MIN_SECS 90
 #define WEBSERVER_TIMEOUT_MAX_SECS 1800
 #define WEBSERVER_TIMEOUT_NOOP 60
+#define WEBSERVER_EVENT_CLIENTS 4
+#define WEBSERVER_EVENT_KEEPALIVE_SECS 15
 
 extern ESP8266WebServer webserver;
 
@@ -26,5 +28,7 @@ bool webserver_stop(bool force);
 void webserver_settimeout(uint16_t timeoutSecs);
 void webserver_tickle();
 uint32_t webserver_idle();
+void webserver_notify();
+void webserver_events();
 
 #endif  
@@ -18,7 +18,18 @@ static bool wifiActive = false;
 static bool wifiAP = false;
 static bool wifiUplink = false;
 static bool mdnsStarted = true;
+static wifiStaStates staState = STA_IDLE;
+static bool staFastConnect = false;
+static uint32_t staMillis = 0;
+static uint16_t staBackoffSecs = 0;
+static uint8_t staNet = 0;
+static uint8_t staTried = 0;  // bitmask of networks tried
+static bool staScanned = false;
+static uint8_t staQueue[WIFI_STA_NETWORKS];
+static uint8_t staQueueLen = 0, staQueuePos = 0;
+static wificache_t wifiCache;
 wifiprefs_t wifiSettings;
+wifinets_t wifiNetworks;
 
 
 static bool printWifiSettings(wifiprefs_t *s) {
@@ -65,6 +76,12 @@ static void setDefaults(wifiprefs_t *s) {
 }
 
 
+static void setDefaults(wifinets_t *s) {
+  memset(s, 0, sizeof(*s));
+  s->crc = crc16((uint8_t *) s, offsetof(wifinets_t, crc));
+}
+
+
 static void wifi_mdns() {
   if (!mdnsStarted && !MDNS.begin(MDNS_NAME)) 
     Serial.println(F("WiFi: failed to setup MDNS responder!"));
@@ -83,9 +100,7 @@ static bool wifi_init() {
     Serial.println(F("WiFi failed!"));
     logMsg("wifi failed");
     blink_leds(HALF_RING, RED, 250, 2, false);
-    delay(750);
   }
-  delay(250);
   return wifiActive;
 }
 
@@ -117,55 +132,296 @@ bool wifi_start_ap(const char* ssid, const char* pass) {
     logMsg("access point failed");
     blink_leds(SYSTEM_LEDS, RED, 250, 2, true);
   }
-  delay(1000);
   return wifiAP;
 }
 
 
-static bool wifi_start_sta(const char* ssid, const char* pass, uint8_t timeoutSecs) {
-  uint8_t ticks = 0;
-  char buf[64];
+// SSID and password of known network i (0 is primary network)
+static const char* wifi_ssid(uint8_t i) {
+  return i ? wifiNetworks.alt[i-1].ssid : wifiSettings.wifiStaSSID;
+}
 
-  if (!strlen(ssid)) {
-    Serial.println(F("WiFi: failed to connect to station, no SSID set!"));
-    return false;
-  } else if (!wifiActive && !wifi_init())
-    return false;
 
-  if (wifiUplink && WiFi.status() == WL_CONNECTED)
-    return true;
+static const char* wifi_password(uint8_t i) {
+  return i ? wifiNetworks.alt[i-1].password : wifiSettings.wifiStaPassword;
+}
 
-  Serial.printf("WiFi: connecting to SSID %s...", ssid);
-  WiFi.begin(ssid, pass);
-  save_leds();
-  set_leds(SYSTEM_LEDS, BLUE);
-  while (WiFi.status() != WL_CONNECTED && (ticks/2) <= timeoutSecs) {
-    Serial.print(".");
-    Serial.flush();
-    delay(500);
-    ticks++;
+
+static uint16_t wifi_ssid_hash(uint8_t i) {
+  return crc16((uint8_t *) wifi_ssid(i), strlen(wifi_ssid(i)));
+}
+
+
+// number of configured networks
+static uint8_t wifi_networks() {
+  uint8_t n = 0;
+
+  for (uint8_t i = 0; i < WIFI_STA_NETWORKS; i++)
+    if (strlen(wifi_ssid(i)))
+      n++;
+  return n;
+}
+
+
+// successful connects raise, failed ones lower a network's score
+static void wifi_score(uint8_t i, int8_t delta) {
+  int8_t score = wifiNetworks.score[i] + delta;
+
+  if (score >= -WIFI_SCORE_MAX && score <= WIFI_SCORE_MAX)
+    wifiNetworks.score[i] = score;
+}
+
+
+// invalidate cached channel/BSSID (and IP) to force a full scan
+static void wifi_cache_clear() {
+  memset(&wifiCache, 0, sizeof(wifiCache));
+}
+
+
+// remember channel, BSSID and DHCP lease of current connection
+// for fast reconnects, EEPROM is only written if anything changed
+static void wifi_cache_update() {
+  wificache_t c;
+
+  memset(&c, 0, sizeof(c));
+  c.ssidHash = wifi_ssid_hash(staNet);
+  memcpy(c.bssid, WiFi.BSSID(), sizeof(c.bssid));
+  c.channel = WiFi.channel();
+  c.ip = WiFi.localIP();
+  c.gateway = WiFi.gatewayIP();
+  c.subnet = WiFi.subnetMask();
+  c.dns = WiFi.dnsIP();
+  c.crc = crc16((uint8_t *) &c, offsetof(wificache_t, crc));
+  if (c.crc != wifiCache.crc) {
+    memcpy(&wifiCache, &c, sizeof(wifiCache));
+    saveSettings(wifiCache, EEPROM_WIFI_CACHE_ADDR, "WiFi cache");
   }
-  restore_leds();
-  delay(500);
-    
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.printf("with IP %s.\n", WiFi.localIP().toString().c_str());
-    sprintf(buf, "connect ssid %s, ip %s", ssid, WiFi.localIP().toString().c_str());
-    logMsg(buf);
-    blink_leds(SYSTEM_LEDS, GREEN, 100, 2, true);
-    wifi_mdns();
-    wifiSettings.enableWLANUplink = true;
-    wifiUplink = true;
+}
+
+
+// cache is only used if it matches the network's SSID
+static bool wifi_cache_valid(uint8_t i) {
+  return (wifiCache.crc && wifiCache.channel && wifiCache.ssidHash == wifi_ssid_hash(i));
+}
+
+
+static void wifi_sta_begin(uint8_t i) {
+  staNet = i;
+  staTried |= (1 << i);
+  staFastConnect = wifi_cache_valid(i);
+  Serial.printf("WiFi: connecting to SSID %s%s...\n", wifi_ssid(i),
+    staFastConnect ? " (cached channel)" : "");
+  if (staFastConnect) {
+#ifdef WIFI_STA_CACHE_IP
+    if (wifiCache.ip)  // skip DHCP, reuse last lease
+      WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway),
+        IPAddress(wifiCache.subnet), IPAddress(wifiCache.dns));
+#endif
+    WiFi.begin(wifi_ssid(i), wifi_password(i), wifiCache.channel, wifiCache.bssid);
   } else {
-    Serial.println(F("failed!"));
-    blink_leds(SYSTEM_LEDS, RED, 250, 2, true);
-    wifiUplink = false;
+#ifdef WIFI_STA_CACHE_IP
+    WiFi.config(IPAddress(0u), IPAddress(0u), IPAddress(0u));  // back to DHCP
+#endif
+    WiFi.begin(wifi_ssid(i), wifi_password(i));
+  }
+  staMillis = millis();
+  staState = STA_CONNECTING;
+}
+
+
+// rank known networks found by scan which haven't been tried yet;
+// signal strength is biased by score to skip failing credentials
+static void wifi_scan_results(int8_t n) {
+  int16_t rank[WIFI_STA_NETWORKS], rssi;
+  uint8_t i, k;
+
+  staQueueLen = 0;
+  staQueuePos = 0;
+  for (i = 0; i < WIFI_STA_NETWORKS; i++) {
+    if (!strlen(wifi_ssid(i)) || (staTried & (1 << i)))
+      continue;
+    rssi = (n < 0) ? 0 : INT16_MIN; // scan failed, try all networks
+    for (k = 0; n > 0 && k < n; k++)
+      if (!strcmp(WiFi.SSID(k).c_str(), wifi_ssid(i)) && WiFi.RSSI(k) > rssi)
+        rssi = WiFi.RSSI(k);
+    if (rssi == INT16_MIN)
+      continue;
+    rank[i] = rssi + wifiNetworks.score[i] * WIFI_SCORE_WEIGHT;
+
+    // insert into queue sorted by rank
+    for (k = staQueueLen; k > 0 && rank[staQueue[k-1]] < rank[i]; k--)
+      staQueue[k] = staQueue[k-1];
+    staQueue[k] = i;
+    staQueueLen++;
+  }
+  Serial.printf("WiFi: found %d of %d known networks.\n", staQueueLen, wifi_networks());
+}
+
+
+static void wifi_sta_backoff() {
+  staBackoffSecs = staBackoffSecs ? staBackoffSecs * 2 : WIFI_BACKOFF_MIN_SECS;
+  if (staBackoffSecs > WIFI_BACKOFF_MAX_SECS)
+    staBackoffSecs = WIFI_BACKOFF_MAX_SECS;
+  Serial.printf("WiFi: no uplink, retry in %d secs.\n", staBackoffSecs);
+  blink_leds(SYSTEM_LEDS, RED, 250, 2, true);
+  wifiUplink = false;
+  staMillis = millis();
+  staState = STA_BACKOFF;
+}
+
+
+// try next ranked network; after last good network has failed
+// scan once for other known networks, back off if none is left
+static void wifi_sta_next() {
+  uint8_t i;
+
+  if (staQueuePos < staQueueLen) {
+    wifi_sta_begin(staQueue[staQueuePos++]);
+    return;
+  }
+  if (!staScanned) {
+    for (i = 0; i < WIFI_STA_NETWORKS; i++) {
+      if (strlen(wifi_ssid(i)) && !(staTried & (1 << i))) {
+        Serial.println(F("WiFi: scanning for known networks..."));
+        WiFi.scanDelete();
+        WiFi.scanNetworks(true);  // async
+        staScanned = true;
+        staMillis = millis();
+        staState = STA_SCANNING;
+        return;
+      }
+    }
+  }
+  wifi_sta_backoff();
+}
+
+
+static void wifi_sta_connected() {
+  char buf[80];
+
+  Serial.printf("WiFi: connected to SSID %s (channel %d, RSSI %d dBm) with IP %s.\n",
+    wifi_ssid(staNet), WiFi.channel(), WiFi.RSSI(), WiFi.localIP().toString().c_str());
+  sprintf(buf, "connect ssid %s, ip %s, rssi %d", wifi_ssid(staNet),
+    WiFi.localIP().toString().c_str(), WiFi.RSSI());
+  logMsg(buf);
+  blink_leds(SYSTEM_LEDS, GREEN, 100, 2, true);
+  wifi_mdns();
+  wifi_powersave();
+  wifi_cache_update();
+  wifi_score(staNet, 1);
+  wifiNetworks.lastGood = staNet;
+  saveWifiNetworks();
+  wifiSettings.enableWLANUplink = true;
+  wifiUplink = true;
+  staBackoffSecs = 0;
+  staState = STA_CONNECTED;
+}
+
+
+static void wifi_sta_failed() {
+  char buf[64];
+
+  WiFi.disconnect();
+  if (staFastConnect) {  // AP might have changed channel, retry with full scan
+    Serial.println(F("WiFi: fast reconnect failed, scanning all channels..."));
+    wifi_cache_clear();
+    wifi_sta_begin(staNet);
+    return;
+  }
+  Serial.printf("WiFi: failed to connect to SSID %s.\n", wifi_ssid(staNet));
+  sprintf(buf, "connect ssid %s failed", wifi_ssid(staNet));
+  logMsg(buf);
+  wifi_score(staNet, -1);
+  wifi_sta_next();
+}
+
+
+// start association with WiFi station in background, tries last
+// good network first (with cached channel/BSSID); returns immediately
+void wifi_connect() {
+  if (!wifi_networks() || (!wifiActive && !wifi_init()))
+    return;
+  if (staState == STA_CONNECTING || staState == STA_SCANNING || staState == STA_CONNECTED)
+    return;
+  if (staState == STA_BACKOFF && (millis() - staMillis) < (staBackoffSecs * 1000UL))
+    return;
+
+  staTried = 0;
+  staScanned = false;
+  staQueueLen = 0;
+  staQueuePos = 0;
+  if (strlen(wifi_ssid(wifiNetworks.lastGood)))
+    wifi_sta_begin(wifiNetworks.lastGood);
+  else
+    wifi_sta_next();
+}
+
+
+// WiFi station state machine, called from loop()
+void wifi_handle() {
+  int8_t n;
+
+  if (!wifiActive)
+    return;
+
+  switch (staState) {
+    case STA_CONNECTING:
+      if (WiFi.status() == WL_CONNECTED)
+        wifi_sta_connected();
+      else if ((millis() - staMillis) > (WIFI_STA_CONNECT_TIMEOUT * 1000UL))
+        wifi_sta_failed();
+      break;
+    case STA_SCANNING:
+      n = WiFi.scanComplete();
+      if (n == WIFI_SCAN_RUNNING && (millis() - staMillis) < (WIFI_SCAN_TIMEOUT * 1000UL))
+        break;
+      wifi_scan_results(n);
+      WiFi.scanDelete();
+      wifi_sta_next();
+      break;
+    case STA_CONNECTED:
+      if (WiFi.status() != WL_CONNECTED) {
+        Serial.println(F("WiFi: uplink lost."));
+        logMsg("wifi uplink lost");
+        wifiUplink = false;
+        staState = STA_IDLE;
+      }
+      break;
+    default:  // SDK might have reconnected on its own
+      if (WiFi.status() == WL_CONNECTED)
+        wifi_sta_connected();
+      break;
+  }
+}
+
+
+// wait for pending connection attempts to finish (used in setup),
+// continues in background when timeout is reached
+bool wifi_wait(uint8_t timeoutSecs) {
+  uint32_t start = millis();
+
+  while ((staState == STA_CONNECTING || staState == STA_SCANNING) &&
+      (millis() - start) < (timeoutSecs * 1000UL)) {
+    delay(100);
+    wifi_handle();
   }
-  delay(1000);
   return wifiUplink;
 }
 
 
+// signal strength of WiFi uplink in dBm, 0 if not connected
+int8_t wifi_rssi() {
+  return (staState == STA_CONNECTED) ? WiFi.RSSI() : 0;
+}
+
+
+// let WiFi enter light sleep between DTIM beacons in low
+// power mode (only effective while the local AP is down)
+void wifi_powersave() {
+  WiFi.setSleepMode(powerSettings.lowPower ? WIFI_LIGHT_SLEEP : WIFI_MODEM_SLEEP);
+}
+
+
 // start or stop local access point
 bool wifi_hotspot(bool terminate) {
   if (terminate) {
@@ -181,12 +437,12 @@ bool wifi_hotspot(bool terminate) {
 }
 
 
-// check for WiFi uplink
-// triggers new connection if reconnect is set
+// check for WiFi uplink, never blocks; if reconnect is set a new
+// connection attempt is started (unless backing off from failures)
 bool wifi_uplink(bool reconnect) {
-  if (!reconnect)
-    return (WiFi.status() == WL_CONNECTED);
-  return wifi_start_sta(wifiSettings.wifiStaSSID, wifiSettings.wifiStaPassword, WIFI_STA_CONNECT_TIMEOUT);
+  if (reconnect && staState != STA_CONNECTED)
+    wifi_connect();
+  return (staState == STA_CONNECTED && WiFi.status() == WL_CONNECTED);
 }
 
 
@@ -204,6 +460,8 @@ void wifi_stop() {
   wifiActive = false;
   wifiUplink = false;
   wifiAP = false;
+  staState = STA_IDLE;
+  staBackoffSecs = 0;
   Serial.println(F("WiFi stopped."));
   Serial.flush();
   logMsg("wifi stopped");
@@ -217,11 +475,24 @@ void loadWifiSettings() {
   setDefaults(&wifiSettings);  // set struct with defaults values from config.h
   loadSettings(&wifiSettings, &buf, offsetof(wifiprefs_t, crc), EEPROM_WIFI_PREFS_ADDR, "WiFi settings");
   printWifiSettings(&wifiSettings);
+  wifinets_t nbuf;
+  setDefaults(&wifiNetworks);
+  loadSettings(&wifiNetworks, &nbuf, offsetof(wifinets_t, crc), EEPROM_WIFI_NETWORKS_ADDR, "WiFi networks");
+  if (wifiNetworks.lastGood >= WIFI_STA_NETWORKS)
+    wifiNetworks.lastGood = 0;
+  if (wifiSettings.enableWLANUplink) {
+    wificache_t cbuf;
+    wifi_cache_clear();
+    loadSettings(&wifiCache, &cbuf, offsetof(wificache_t, crc), EEPROM_WIFI_CACHE_ADDR, "WiFi cache");
+  }
 }
 
 
 bool saveWifiSettings() {
   if (wifiSettings.crc) { // use an existing crc as flag for a valid settings struct
+    if (staState == STA_BACKOFF)  // credentials might have changed, retry now
+      staState = STA_IDLE;
+    staBackoffSecs = 0;
     wifiSettings.crc = crc16((uint8_t *) &wifiSettings, offsetof(wifiprefs_t, crc));
     return saveSettings(wifiSettings, EEPROM_WIFI_PREFS_ADDR, "WiFi settings") && printWifiSettings(&wifiSettings);
   }
@@ -229,10 +500,26 @@ bool saveWifiSettings() {
 }
 
 
+// list of alternative networks, score and last good network;
+// EEPROM is only written if anything changed
+bool saveWifiNetworks() {
+  uint16_t crc = crc16((uint8_t *) &wifiNetworks, offsetof(wifinets_t, crc));
+
+  if (crc == wifiNetworks.crc)
+    return true;
+  wifiNetworks.crc = crc;
+  return saveSettings(wifiNetworks, EEPROM_WIFI_NETWORKS_ADDR, "WiFi networks");
+}
+
+
 bool resetWifiSettings() {
   Serial.println(F("Reset WiFi settings."));
   logMsg("reset WiFi settings");
   memset(&wifiSettings, 0, sizeof(wifiSettings));
   setDefaults(&wifiSettings);
+  wifi_cache_clear();
+  saveSettings(wifiCache, EEPROM_WIFI_CACHE_ADDR, "WiFi cache");
+  setDefaults(&wifiNetworks);
+  saveSettings(wifiNetworks, EEPROM_WIFI_NETWORKS_ADDR, "WiFi networks");
   return saveSettings(wifiSettings, EEPROM_WIFI_PREFS_ADDR, "WiFi settings") && printWifiSettings(&wifiSettings);
 }
@@ -21,6 +21,17 @@
 #define WIFI_STA_CONNECT_TIMEOUT 10
 #define MDNS_NAME "ampel"  // ampel.local
 #define EEPROM_WIFI_PREFS_ADDR 0x100
+#define EEPROM_WIFI_CACHE_ADDR 0x180
+#define EEPROM_WIFI_NETWORKS_ADDR 0x800
+#define WIFI_STA_NETWORKS 4  // primary and three alternative networks
+#define WIFI_SCAN_TIMEOUT 8
+#define WIFI_SCORE_MAX 8
+#define WIFI_SCORE_WEIGHT 3  // dB per score point
+#define WIFI_BACKOFF_MIN_SECS 15
+#define WIFI_BACKOFF_MAX_SECS 900
+//#define WIFI_STA_CACHE_IP  // reuse last DHCP lease on fast reconnect
+
+enum wifiStaStates { STA_IDLE, STA_CONNECTING, STA_SCANNING, STA_CONNECTED, STA_BACKOFF };
 
 typedef struct {
   bool webserverAutoOff;
@@ -33,13 +44,45 @@ typedef struct {
   uint16_t crc = 0;
 } wifiprefs_t;
 
+typedef struct {
+  char ssid[32];
+  char password[32];
+} wifinet_t;
+
+// alternative networks, credential score and last good network
+typedef struct {
+  wifinet_t alt[WIFI_STA_NETWORKS-1];
+  int8_t score[WIFI_STA_NETWORKS];
+  uint8_t lastGood;
+  uint16_t crc = 0;
+} wifinets_t;
+
+// last successful connection for fast reconnects
+typedef struct {
+  uint16_t ssidHash;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint16_t crc = 0;
+} wificache_t;
+
 extern wifiprefs_t wifiSettings;
+extern wifinets_t wifiNetworks;
 
 bool wifi_hotspot(bool terminate);
 bool wifi_uplink(bool reconnect);
+void wifi_connect();
+void wifi_handle();
+bool wifi_wait(uint8_t timeoutSecs);
+int8_t wifi_rssi();
+void wifi_powersave();
 void wifi_stop();
 void loadWifiSettings();
 bool saveWifiSettings();
+bool saveWifiNetworks();
 bool resetWifiSettings();
 
 #endif
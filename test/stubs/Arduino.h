@@ -0,0 +1,91 @@
+#pragma once
+// declarations of the ESP8266 Arduino core used by the sketch, only
+// functions called by the modules under test are defined in support.cpp
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <ctype.h>
+#include <limits.h>
+#include <algorithm>
+typedef uint8_t byte;
+typedef bool boolean;
+#define PROGMEM
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper*)(s))
+#define FPSTR(p) ((const __FlashStringHelper*)(p))
+#define A0 17
+#define INPUT 0
+#define OUTPUT 1
+#define HIGH 1
+#define LOW 0
+#define HEX 16
+#define DEC 10
+#define SDA 4
+#define SCL 5
+#define INPUT_PULLUP 2
+#define OPEN_DRAIN 3
+#define PI 3.14159265
+using std::min; using std::max;
+#define sq(x) ((x)*(x))
+template<class T> T constrain(T a, T l, T h){return a<l?l:a>h?h:a;}
+long map(long,long,long,long,long);
+long random(long); long random(long,long);
+uint32_t millis(); uint32_t micros(); void delay(uint32_t); void delayMicroseconds(uint32_t); void yield();
+int analogRead(uint8_t); void pinMode(uint8_t,uint8_t); void digitalWrite(uint8_t,uint8_t); int digitalRead(uint8_t);
+char* itoa(int, char*, int); char* utoa(unsigned, char*, int); char* ltoa(long, char*, int); char* ultoa(unsigned long, char*, int);
+char* dtostrf(double, signed char, unsigned char, char*);
+void* memcpy_P(void*, const void*, size_t);
+size_t strlen_P(const char*); int strncmp_P(const char*, const char*, size_t); char* strcpy_P(char*, const char*);
+uint8_t pgm_read_byte(const void*); uint16_t pgm_read_word(const void*); uint32_t pgm_read_dword(const void*);
+const void* pgm_read_ptr(const void*);
+class String {
+public:
+  String(); String(const char*); String(const String&); String(const __FlashStringHelper*);
+  explicit String(int, unsigned char base=10); explicit String(unsigned, unsigned char base=10);
+  explicit String(long, unsigned char base=10); explicit String(unsigned long, unsigned char base=10);
+  explicit String(float, unsigned char d=2); explicit String(double, unsigned char d=2); explicit String(char);
+  String& operator=(const String&); String& operator=(const char*);
+  String& operator+=(const String&); String& operator+=(const char*); String& operator+=(char);
+  String& operator+=(int); String& operator+=(unsigned); String& operator+=(long); String& operator+=(unsigned long);
+  String& operator+=(const __FlashStringHelper*);
+  friend String operator+(const String&, const String&); friend String operator+(const String&, const char*);
+  friend String operator+(const char*, const String&); friend String operator+(const String&, int);
+  friend String operator+(const String&, unsigned); friend String operator+(const String&, char);
+  bool operator==(const String&) const; bool operator==(const char*) const; bool operator!=(const char*) const;
+  const char* c_str() const; unsigned length() const; long toInt() const; float toFloat() const;
+  void replace(const String&, const String&); void replace(const char*, const char*); 
+  String substring(unsigned, unsigned) const; String substring(unsigned) const;
+  bool endsWith(const String&) const; bool startsWith(const String&) const; int indexOf(const char*) const; int indexOf(char) const; int lastIndexOf(char) const;
+  void reserve(unsigned); void toCharArray(char*, unsigned) const; void concat(const char*, unsigned); bool concat(const char*);
+  char operator[](unsigned) const; void trim(); bool isEmpty() const;
+};
+class Print {
+public:
+  size_t print(const char*); size_t print(const String&); size_t print(const __FlashStringHelper*); size_t print(char);
+  size_t print(int, int=DEC); size_t print(unsigned, int=DEC); size_t print(long, int=DEC); size_t print(unsigned long, int=DEC);
+  size_t print(double, int=2);
+  size_t println(const char*); size_t println(const String&); size_t println(const __FlashStringHelper*); size_t println(char);
+  size_t println(int, int=DEC); size_t println(unsigned, int=DEC); size_t println(long, int=DEC); size_t println(unsigned long, int=DEC);
+  size_t println(double, int=2); size_t println();
+  size_t printf(const char*, ...) __attribute__((format(printf,2,3)));
+  size_t printf_P(const char*, ...);
+  virtual size_t write(uint8_t); size_t write(const uint8_t*, size_t); size_t write(const char*, size_t); size_t write(const char*);
+  void flush();
+};
+class Stream : public Print { public: int available(); int read(); void setTimeout(unsigned long); };
+class HardwareSerial : public Stream { public: void begin(unsigned long); };
+extern HardwareSerial Serial;
+struct rst_info { uint32_t reason; };
+class EspClass {
+public:
+  String getCoreVersion(); rst_info* getResetInfoPtr(); void deepSleep(uint64_t); void restart();
+  uint32_t getFreeSketchSpace(); bool rtcUserMemoryRead(uint32_t, uint32_t*, size_t); bool rtcUserMemoryWrite(uint32_t, uint32_t*, size_t);
+  uint32_t getCycleCount(); uint32_t getFreeHeap(); uint64_t deepSleepMax(); uint32_t getChipId();
+};
+extern EspClass ESP;
+class UpdaterClass { public: bool hasError(); bool begin(size_t); size_t write(uint8_t*, size_t); bool end(bool); void printError(Print&); };
+extern UpdaterClass Update;
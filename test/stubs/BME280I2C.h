@@ -0,0 +1,16 @@
+#pragma once
+#include <Arduino.h>
+class BME280 { public:
+  enum ChipModel { ChipModel_UNKNOWN = 0, ChipModel_BMP280 = 0x58, ChipModel_BME280 = 0x60 };
+  enum TempUnit { TempUnit_Celsius, TempUnit_Fahrenheit };
+  enum PresUnit { PresUnit_Pa, PresUnit_hPa, PresUnit_inHg };
+  enum OSR { OSR_Off, OSR_X1, OSR_X2, OSR_X4, OSR_X8, OSR_X16 };
+  enum Mode { Mode_Sleep, Mode_Forced, Mode_Normal = 3 };
+  enum StandbyTime { StandbyTime_500us, StandbyTime_62500us, StandbyTime_125ms, StandbyTime_250ms, StandbyTime_50ms, StandbyTime_1000ms, StandbyTime_10ms, StandbyTime_20ms };
+  enum Filter { Filter_Off, Filter_2, Filter_4, Filter_8, Filter_16 };
+  enum SpiEnable { SpiEnable_False, SpiEnable_True };
+  bool begin(); float temp(TempUnit=TempUnit_Celsius); float pres(PresUnit=PresUnit_Pa); float hum(); void read(float&, float&, float&, TempUnit=TempUnit_Celsius, PresUnit=PresUnit_Pa); ChipModel chipModel(); };
+class BME280I2C : public BME280 { public:
+  enum I2CAddr { I2CAddr_0x76 = 0x76, I2CAddr_0x77 = 0x77 };
+  struct Settings { Settings(OSR t=OSR_X1, OSR h=OSR_X1, OSR p=OSR_X1, Mode m=Mode_Forced, StandbyTime st=StandbyTime_1000ms, Filter f=Filter_Off, SpiEnable s=SpiEnable_False, I2CAddr a=I2CAddr_0x76); OSR tempOSR, humOSR, presOSR; Mode mode; StandbyTime standbyTime; Filter filter; I2CAddr bme280Addr; };
+  BME280I2C(const Settings& s = Settings()); void setSettings(const Settings&); const Settings& getSettings() const; };
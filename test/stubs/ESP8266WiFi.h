@@ -0,0 +1,32 @@
+#pragma once
+#include <Arduino.h>
+class IPAddress { public: IPAddress(); IPAddress(uint8_t,uint8_t,uint8_t,uint8_t); IPAddress(uint32_t); String toString() const; operator uint32_t() const; bool isSet() const; uint8_t operator[](int) const; };
+enum wl_status_t { WL_IDLE_STATUS, WL_NO_SSID_AVAIL, WL_SCAN_COMPLETED, WL_CONNECTED, WL_CONNECT_FAILED, WL_CONNECTION_LOST, WL_WRONG_PASSWORD, WL_DISCONNECTED };
+enum WiFiMode_t { WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA };
+enum WiFiSleepType_t { WIFI_NONE_SLEEP, WIFI_LIGHT_SLEEP, WIFI_MODEM_SLEEP };
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+class Client : public Stream { public: };
+class WiFiClient : public Client {
+public: WiFiClient(); bool connected(); uint8_t connected() const; void stop(); void setNoDelay(bool); size_t write(Stream&); size_t write(const uint8_t*, size_t); size_t write(const char*, size_t); size_t write(uint8_t) override; int availableForWrite(); operator bool(); void setSync(bool); bool stop(unsigned); void flush(); IPAddress remoteIP(); uint16_t remotePort();
+};
+class WiFiEventHandler_ {}; typedef WiFiEventHandler_* WiFiEventHandler;
+struct WiFiEventStationModeGotIP { IPAddress ip, mask, gw; };
+struct WiFiEventStationModeDisconnected { String ssid; uint8_t bssid[6]; int reason; };
+struct WiFiEventStationModeConnected { String ssid; uint8_t bssid[6]; uint8_t channel; };
+#include <functional>
+class ESP8266WiFiClass {
+public:
+  bool mode(WiFiMode_t); WiFiMode_t getMode(); wl_status_t status(); bool softAP(const char*, const char*); IPAddress softAPIP(); bool softAPdisconnect(bool);
+  wl_status_t begin(const char*, const char*, int32_t channel=0, const uint8_t* bssid=nullptr, bool connect=true); wl_status_t begin();
+  bool disconnect(bool wifioff=false); void forceSleepBegin(); void forceSleepWake(); IPAddress localIP(); IPAddress gatewayIP(); IPAddress subnetMask(); IPAddress dnsIP(uint8_t=0);
+  uint8_t* macAddress(uint8_t*); String macAddress(); int32_t RSSI(); int32_t RSSI(uint8_t); String SSID(); String SSID(uint8_t); uint8_t* BSSID(); uint8_t* BSSID(uint8_t); String BSSIDstr(); int32_t channel(); int32_t channel(uint8_t);
+  bool config(IPAddress, IPAddress, IPAddress, IPAddress dns1=IPAddress(), IPAddress dns2=IPAddress());
+  int8_t scanNetworks(bool async=false, bool hidden=false); void scanNetworksAsync(std::function<void(int)>, bool hidden=false); int8_t scanComplete(); void scanDelete();
+  bool setAutoReconnect(bool); bool setAutoConnect(bool); bool persistent(bool); bool setSleepMode(WiFiSleepType_t, uint8_t=0); bool isConnected(); bool hostname(const char*);
+  WiFiEventHandler onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP&)>);
+  WiFiEventHandler onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected&)>);
+  WiFiEventHandler onStationModeConnected(std::function<void(const WiFiEventStationModeConnected&)>);
+};
+extern ESP8266WiFiClass WiFi;
+#include "user_interface.h"
@@ -0,0 +1,6 @@
+#pragma once
+#include <Arduino.h>
+class File : public Stream { public: operator bool() const; size_t size(); const char* name(); void close(); size_t position(); bool seek(uint32_t); size_t read(uint8_t*, size_t); int read(); String readStringUntil(char); };
+class Dir { public: bool next(); File openFile(const char*); String fileName(); size_t fileSize(); };
+struct FSInfo { size_t totalBytes, usedBytes; };
+class FS { public: bool begin(); bool info(FSInfo&); File open(const String&, const char*); File open(const char*, const char*); Dir openDir(const char*); bool exists(const String&); bool exists(const char*); bool remove(const String&); bool remove(const char*); bool rename(const String&, const String&); bool rename(const char*, const char*); };
@@ -0,0 +1,6 @@
+#pragma once
+#include <Arduino.h>
+struct CRGB { enum HTMLColorCode { Green=0x008000, Red=0xFF0000, Blue=0x0000FF, Yellow=0xFFFF00, Magenta=0xFF00FF, White=0xFFFFFF, Cyan=0x00FFFF, DarkOrange=0xFF8C00 }; CRGB(); CRGB(uint32_t); CRGB& operator=(uint32_t); operator long() const; };
+#define NEOPIXEL 1
+class CFastLED { public: template<int T, int P> void addLeds(CRGB*, int); void show(); void setBrightness(uint8_t); uint8_t getBrightness(); };
+extern CFastLED FastLED;
@@ -0,0 +1,3 @@
+#pragma once
+#include <WiFiUdp.h>
+class NTPClient { public: NTPClient(WiFiUDP&, const char*, long); void begin(); bool forceUpdate(); bool update(); unsigned long getEpochTime(); void end(); bool isTimeSet() const; };
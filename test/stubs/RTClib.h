@@ -0,0 +1,4 @@
+#pragma once
+#include <Arduino.h>
+class DateTime { public: DateTime(uint32_t t=0); uint32_t unixtime() const; uint8_t minute() const; uint8_t second() const; uint8_t hour() const; uint8_t day() const; uint8_t month() const; uint16_t year() const; };
+class RTC_DS3231 { public: bool begin(); void disable32K(); float getTemperature(); DateTime now(); void adjust(const DateTime&); bool lostPower(); };
@@ -0,0 +1,3 @@
+#pragma once
+#include <Arduino.h>
+class RunningMedian { public: RunningMedian(uint8_t); void clear(); void add(float); float getMedian(); float getAverage(); float getAverage(uint8_t); float getElement(uint8_t); uint8_t getSize(); uint8_t getCount(); float getHighest(); float getLowest(); };
@@ -0,0 +1,4 @@
+#pragma once
+#include <Arduino.h>
+#include <Wire.h>
+class SCD30 { public: bool begin(bool autoCal=true); bool begin(TwoWire&, bool autoCal=true); bool setMeasurementInterval(uint16_t); bool setAltitudeCompensation(uint16_t); bool setAmbientPressure(uint16_t); bool setTemperatureOffset(float); float getTemperatureOffset(); bool readMeasurement(); float getTemperature(); float getHumidity(); uint16_t getCO2(); bool setForcedRecalibrationFactor(uint16_t); bool sendCommand(uint16_t); bool sendCommand(uint16_t, uint16_t); bool dataAvailable(); bool setAutoSelfCalibration(bool); bool beginMeasuring(uint16_t); bool beginMeasuring(); bool StopMeasurement(); bool getMeasurementInterval(uint16_t*); };
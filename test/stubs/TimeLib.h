@@ -0,0 +1,9 @@
+#pragma once
+#include <Arduino.h>
+#include <time.h>
+int hour(time_t); int minute(time_t); int second(time_t); int day(time_t); int month(time_t); int year(time_t); int weekday(time_t);
+typedef struct { uint8_t Second, Minute, Hour, Wday, Day, Month, Year; } tmElements_t;
+time_t makeTime(const tmElements_t&); void breakTime(time_t, tmElements_t&);
+#define SECS_PER_HOUR 3600UL
+#define SECS_PER_DAY 86400UL
+#define CalendarYrToTm(Y) ((Y) - 1970)
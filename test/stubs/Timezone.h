@@ -0,0 +1,7 @@
+#pragma once
+#include <TimeLib.h>
+enum week_t {Last, First, Second, Third, Fourth};
+enum dow_t {Sun=1, Mon, Tue, Wed, Thu, Fri, Sat};
+enum month_t {Jan=1, Feb, Mar, Apr, May, Jun, Jul, Aug, Sep, Oct, Nov, Dec};
+struct TimeChangeRule { char abbrev[6]; uint8_t week, dow, month, hour; int offset; };
+class Timezone { public: Timezone(TimeChangeRule, TimeChangeRule); time_t toLocal(time_t); time_t toLocal(time_t, TimeChangeRule**); time_t toUTC(time_t); bool utcIsDST(time_t); bool locIsDST(time_t); };
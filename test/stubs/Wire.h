@@ -0,0 +1,4 @@
+#pragma once
+#include <Arduino.h>
+class TwoWire : public Stream { public: void begin(); void begin(int,int); void setClock(uint32_t); void setClockStretchLimit(uint32_t); void beginTransmission(uint8_t); uint8_t endTransmission(bool stop=true); uint8_t requestFrom(uint8_t, uint8_t); size_t write(uint8_t) override; int status(); };
+extern TwoWire Wire;
@@ -0,0 +1,3 @@
+#pragma once
+#include <Arduino.h>
+class uEEPROMLib { public: uEEPROMLib(uint8_t); bool eeprom_read(unsigned, byte*, unsigned); template<class T> bool eeprom_write(unsigned, T*, unsigned) { return false; } bool eeprom_write(unsigned, byte); byte eeprom_read(unsigned); };
@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+enum { REASON_DEFAULT_RST, REASON_WDT_RST, REASON_EXCEPTION_RST, REASON_SOFT_WDT_RST, REASON_SOFT_RESTART, REASON_DEEP_SLEEP_AWAKE, REASON_EXT_SYS_RST };
+bool system_deep_sleep_set_option(uint8_t);
+enum sleep_type { NONE_SLEEP_T, LIGHT_SLEEP_T, MODEM_SLEEP_T };
+#define NULL_MODE 0
+bool wifi_set_opmode(uint8_t); bool wifi_set_opmode_current(uint8_t);
+void wifi_fpm_set_sleep_type(sleep_type); void wifi_fpm_open(); void wifi_fpm_close();
+typedef void (*fpm_wakeup_cb)(void);
+void wifi_fpm_set_wakeup_cb(fpm_wakeup_cb); int8_t wifi_fpm_do_sleep(uint32_t);
+void gpio_pin_wakeup_enable(uint32_t, int);
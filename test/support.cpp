@@ -0,0 +1,148 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "test.h"
+#include <stdarg.h>
+#include <time.h>
+#include <TimeLib.h>
+#include <Timezone.h>
+#include <uEEPROMLib.h>
+
+// host versions of the Arduino core and library functions used by
+// the modules under test; console output of the sketch is dropped
+
+uint32_t testMillis = 0;
+int testFailures = 0;
+HardwareSerial Serial;
+
+
+int testResult(const char *name) {
+  printf("%s: %s\n", name, testFailures ? "FAILED" : "OK");
+  return testFailures ? 1 : 0;
+}
+
+
+uint32_t millis() { return testMillis; }
+void delay(uint32_t ms) { testMillis += ms; }
+
+size_t Print::print(const char*) { return 0; }
+size_t Print::print(const String&) { return 0; }
+size_t Print::print(const __FlashStringHelper*) { return 0; }
+size_t Print::print(char) { return 0; }
+size_t Print::print(int, int) { return 0; }
+size_t Print::print(unsigned, int) { return 0; }
+size_t Print::print(long, int) { return 0; }
+size_t Print::print(unsigned long, int) { return 0; }
+size_t Print::print(double, int) { return 0; }
+size_t Print::println(const char*) { return 0; }
+size_t Print::println(const String&) { return 0; }
+size_t Print::println(const __FlashStringHelper*) { return 0; }
+size_t Print::println(char) { return 0; }
+size_t Print::println(int, int) { return 0; }
+size_t Print::println(unsigned, int) { return 0; }
+size_t Print::println(long, int) { return 0; }
+size_t Print::println(unsigned long, int) { return 0; }
+size_t Print::println(double, int) { return 0; }
+size_t Print::println() { return 0; }
+size_t Print::printf(const char*, ...) { return 0; }
+size_t Print::write(uint8_t) { return 0; }
+
+
+// TimeLib, weekday() is 1 for Sunday
+static struct tm breakUTC(time_t t) {
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  return tm;
+}
+
+int hour(time_t t) { return breakUTC(t).tm_hour; }
+int minute(time_t t) { return breakUTC(t).tm_min; }
+int second(time_t t) { return breakUTC(t).tm_sec; }
+int day(time_t t) { return breakUTC(t).tm_mday; }
+int month(time_t t) { return breakUTC(t).tm_mon + 1; }
+int year(time_t t) { return breakUTC(t).tm_year + 1900; }
+int weekday(time_t t) { return breakUTC(t).tm_wday + 1; }
+
+time_t makeTime(const tmElements_t &e) {
+  struct tm tm = {};
+  tm.tm_sec = e.Second;
+  tm.tm_min = e.Minute;
+  tm.tm_hour = e.Hour;
+  tm.tm_mday = e.Day;
+  tm.tm_mon = e.Month - 1;
+  tm.tm_year = e.Year + 70;
+  return timegm(&tm);
+}
+
+
+// Timezone, same rules as the library: a change takes place at the
+// given local time (standard time for the begin of DST and vice versa)
+static TimeChangeRule dstRule, stdRule;
+
+Timezone::Timezone(TimeChangeRule dst, TimeChangeRule std) {
+  dstRule = dst;
+  stdRule = std;
+}
+
+
+// local time of rule r in given year
+static time_t ruleTime(const TimeChangeRule &r, int y) {
+  tmElements_t e = {};
+  uint8_t m = r.month, w = r.week;
+  time_t t;
+
+  if (w == Last) {  // first day of next month, then back one week
+    if (++m > 12) {
+      m = 1;
+      y++;
+    }
+    w = 1;
+  }
+  e.Hour = r.hour;
+  e.Day = 1;
+  e.Month = m;
+  e.Year = y - 1970;
+  t = makeTime(e);
+  t += ((r.dow - weekday(t) + 7) % 7 + (w - 1) * 7) * SECS_PER_DAY;
+  if (r.week == Last)
+    t -= 7 * SECS_PER_DAY;
+  return t;
+}
+
+
+bool Timezone::utcIsDST(time_t utc) {
+  int y = year(utc);
+  return utc >= ruleTime(dstRule, y) - stdRule.offset * 60 &&
+    utc < ruleTime(stdRule, y) - dstRule.offset * 60;
+}
+
+
+bool Timezone::locIsDST(time_t local) {
+  int y = year(local);
+  return local >= ruleTime(dstRule, y) && local < ruleTime(stdRule, y);
+}
+
+
+time_t Timezone::toLocal(time_t utc) {
+  return utc + (utcIsDST(utc) ? dstRule.offset : stdRule.offset) * 60;
+}
+
+
+time_t Timezone::toUTC(time_t local) {
+  return local - (locIsDST(local) ? dstRule.offset : stdRule.offset) * 60;
+}
+
+
+// uEEPROMLib, tests run without EEPROM (i2c_present() is false)
+uEEPROMLib::uEEPROMLib(uint8_t) { }
+
+bool uEEPROMLib::eeprom_read(unsigned, byte*, unsigned) {
+  return false;
+}
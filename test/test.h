@@ -0,0 +1,50 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#ifndef _TEST_H
+#define _TEST_H
+
+#include <Arduino.h>
+#include <stdio.h>
+
+// host tests for the hardware independent parts of the sketch; a
+// failed check is reported with its location, the test goes on and
+// finally exits with status 1
+
+extern uint32_t testMillis;  // returned by millis()
+extern int testFailures;
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    testFailures++; \
+  } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+  long long _a = (a), _b = (b); \
+  if (_a != _b) { \
+    printf("%s:%d: check failed: %s == %s (%lld != %lld)\n", \
+      __FILE__, __LINE__, #a, #b, _a, _b); \
+    testFailures++; \
+  } \
+} while (0)
+
+#define CHECK_STR(a, b) do { \
+  if (strcmp((a), (b))) { \
+    printf("%s:%d: check failed: \"%s\" == \"%s\"\n", __FILE__, __LINE__, (a), (b)); \
+    testFailures++; \
+  } \
+} while (0)
+
+// prints result, returns exit status for main()
+int testResult(const char *name);
+
+#endif
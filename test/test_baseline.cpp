@@ -0,0 +1,113 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "test.h"
+#include "baseline.h"
+#include "sensors.h"
+#include "rtc.h"
+
+// replay of a drifting sensor over several weeks, corrections are
+// applied right away as sensors.cpp does with the next stable reading
+
+static uint32_t now;
+static uint16_t corrections, tooLarge;
+
+time_t rtc_local() { return now; }
+uEEPROMLib rtceeprom(0x57);
+bool i2c_present(i2cDevices) { return false; }  // no EEPROM
+uint32_t i2c_begin(i2cDevices) { return 0; }
+bool i2c_end(i2cDevices, uint32_t, bool success) { return success; }
+uint16_t crc16(const uint8_t*, uint8_t) { return 0; }
+
+void logMsg(char *msg) {
+  if (strstr(msg, "pending"))
+    corrections++;
+  else if (strstr(msg, "too large"))
+    tooLarge++;
+}
+
+
+// simple deterministic noise in [-amp, amp]
+static int16_t noise(int16_t amp) {
+  static uint32_t seed = 1;
+  seed = seed * 1103515245 + 12345;
+  return int16_t((seed >> 16) % (2 * amp + 1)) - amp;
+}
+
+
+// office with fresh air at night and 600-1200ppm during the day,
+// sensor offset in ppm after given days with drift per day; returns
+// remaining offset after applied corrections
+static int16_t replay(uint16_t days, float offset, float drift, uint16_t readingsPerDay,
+    int16_t *maxStep, uint16_t *minGap) {
+  int16_t applied = 0, step;
+  uint16_t lastDay = 0;
+  uint16_t co2;
+
+  *maxStep = 0;
+  *minGap = UINT16_MAX;
+  for (uint16_t d = 0; d < days; d++) {
+    for (uint16_t r = 0; r < readingsPerDay; r++) {
+      now = 1609459200 + d * 86400 + r * (86400 / readingsPerDay);
+      co2 = (r * 24 / readingsPerDay >= 7 && r * 24 / readingsPerDay < 18) ?
+        600 + (r * 7) % 600 : SCD30_CO2_CALIBRATION_VALUE;
+      baseline_add(co2 + lroundf(offset + d * drift) + applied + noise(10));
+      if ((step = baseline_pending())) {
+        applied += step;
+        baseline_applied(step);
+        *maxStep = max(*maxStep, int16_t(abs(step)));
+        if (lastDay)
+          *minGap = min(*minGap, uint16_t(d - lastDay));
+        lastDay = d;
+      }
+    }
+  }
+  return lroundf(offset + days * drift) + applied;
+}
+
+
+int main() {
+  int16_t maxStep, residual;
+  uint16_t minGap;
+
+  // sensor reads 60ppm high and drifts further by 0.3ppm per day
+  residual = replay(60, 60, 0.3, 1440, &maxStep, &minGap);
+  CHECK(abs(residual) <= BASELINE_DEADBAND_PPM + BASELINE_BIN_PPM);
+  CHECK(corrections >= 2);
+  CHECK_EQ(tooLarge, 0);
+  CHECK(maxStep <= BASELINE_MAX_STEP_PPM);
+  CHECK(minGap >= BASELINE_COOLDOWN_DAYS);
+
+  // no correction within the dead band
+  baseline_reset();
+  corrections = 0;
+  residual = replay(30, -20, 0, 1440, &maxStep, &minGap);
+  CHECK_EQ(corrections, 0);
+  CHECK_EQ(residual, -20);
+
+  // first week is only observed
+  baseline_reset();
+  residual = replay(BASELINE_MIN_DAYS, 100, 0, 1440, &maxStep, &minGap);
+  CHECK_EQ(corrections, 0);
+  CHECK_EQ(residual, 100);
+
+  // too few readings per day (device mostly off) are ignored
+  baseline_reset();
+  residual = replay(30, 100, 0, BASELINE_MIN_SAMPLES - 1, &maxStep, &minGap);
+  CHECK_EQ(corrections, 0);
+
+  // larger offsets need manual calibration, corrections stop at the limit
+  baseline_reset();
+  residual = replay(60, 300, 0, 1440, &maxStep, &minGap);
+  CHECK(residual >= 300 - BASELINE_MAX_TOTAL_PPM);
+  CHECK(tooLarge > 0);
+
+  return testResult("baseline");
+}
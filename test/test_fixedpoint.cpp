@@ -0,0 +1,179 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+
+#include "test.h"
+#include "fixedpoint.h"
+#include "config.h"
+#include <chrono>
+
+// integer stdDev(), battery voltage and humidity conversion against
+// the float formulas used before, on the readings of sensor.log;
+// also times stdDev() both ways (host timings, the ESP8266 has no
+// FPU and does each float operation in software)
+
+#define WINDOW 15  // largest running median
+#define ROUNDS 2000
+#define READINGS_MAX 256
+
+static uint16_t co2[READINGS_MAX];
+static int16_t temperature[READINGS_MAX];
+static uint8_t humidity[READINGS_MAX];
+static uint16_t readings = 0;
+
+
+// ring buffer in insertion order like the library, without sorting
+static float values[WINDOW];
+static uint8_t size, count, next;
+
+RunningMedian::RunningMedian(uint8_t n) { size = n; clear(); }
+void RunningMedian::clear() { count = next = 0; }
+void RunningMedian::add(float v) {
+  values[next] = v;
+  next = (next + 1) % size;
+  if (count < size)
+    count++;
+}
+float RunningMedian::getElement(uint8_t i) { return values[i]; }
+uint8_t RunningMedian::getCount() { return count; }
+float RunningMedian::getAverage() {
+  float sum = 0;
+  for (uint8_t i = 0; i < count; i++)
+    sum += values[i];
+  return sum / count;
+}
+
+
+// stdDev() before it was moved to integers, sigma in ppm
+static float stdDevFloat(RunningMedian readings) {
+  int32_t average = 0;
+  uint32_t sqDevSum = 0.0;
+
+  if (readings.getCount() < 5)
+    return UCHAR_MAX;
+
+  average = int(readings.getAverage()*100);
+  for(uint8_t i = 0; i < readings.getCount(); i++) {
+      sqDevSum += pow((average - (readings.getElement(i)*100)), 2);
+  }
+  return sqrt(sqDevSum/readings.getCount())/100;
+}
+
+
+// saturation vapor pressure (Magnus formula) as used before
+static float magnus(int16_t temperature) {
+  float t = temperature / 100.0;
+  return exp(17.62 * t / (243.12 + t));
+}
+
+
+// co2, temperature and humidity of SCD30 readings logged by logReadings()
+static void loadLog(const char *filename) {
+  FILE *f = fopen(filename, "r");
+  char line[160];
+  unsigned ppm, hum;
+  float t;
+
+  if (!f) {
+    printf("cannot open %s\n", filename);
+    exit(1);
+  }
+  while (fgets(line, sizeof(line), f) && readings < READINGS_MAX) {
+    if (sscanf(line, "%*[^,],%*u,%*[^,],%u,%f,%u", &ppm, &t, &hum) != 3)
+      continue;
+    co2[readings] = ppm;
+    temperature[readings] = lroundf(t * 100);
+    humidity[readings++] = hum;
+  }
+  fclose(f);
+}
+
+
+// nanosecs per sample for a window of n readings
+template<typename F>
+static uint32_t timeit(F f, uint8_t n, uint32_t *sum) {
+  RunningMedian window(n);
+  auto start = std::chrono::steady_clock::now();
+
+  for (uint16_t r = 0; r < ROUNDS; r++) {
+    for (uint16_t i = 0; i < readings; i++) {
+      window.add(co2[i]);
+      *sum += f(window);
+    }
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - start).count() / (uint64_t(ROUNDS) * readings * n);
+}
+
+
+int main() {
+  uint32_t sigma, sum = 0, tInt, tFloat, humNew, humMismatch = 0;
+  int32_t humOld;
+  float ref;
+
+  loadLog("sensor.log");
+  CHECK(readings > 100);
+
+  // isqrt() is exact
+  for (uint64_t v : { 0ULL, 1ULL, 2ULL, 3ULL, 4ULL, 99ULL, 100ULL, 65535ULL,
+      4294967295ULL, 4294967296ULL, (1ULL << 62) - 1, 1ULL << 62 }) {
+    sigma = isqrt(v);
+    CHECK(uint64_t(sigma) * sigma <= v);
+    CHECK((uint64_t(sigma) + 1) * (uint64_t(sigma) + 1) > v);
+  }
+
+  // same sigma as before within the old truncation to 1/100 ppm,
+  // for the default and the largest running median
+  for (uint8_t n : { SCD30_NUM_SAMPLES_MEDIAN, WINDOW }) {
+    RunningMedian window(n);
+    for (uint16_t i = 0; i < readings; i++) {
+      window.add(co2[i]);
+      sigma = stdDev(window, false);
+      ref = stdDevFloat(window);
+      CHECK(fabsf(sigma - ref * 100) <= 1.0f);
+    }
+  }
+  RunningMedian few(WINDOW);
+  for (uint8_t i = 0; i < 4; i++)
+    few.add(800);
+  CHECK_EQ(stdDev(few, false), UCHAR_MAX * 100);
+
+  // battery voltage over the whole ADC range (sum of 10 samples),
+  // the float result was truncated to mV by every consumer
+  for (uint32_t raw = 0; raw <= 10 * 1023; raw++) {
+    ref = (raw/10.0*VBAT_ADJUST)/1024.0;
+    CHECK(fabsf(adc_vbat_mv(raw, 10) - ref * 1000) < 1.0f);
+  }
+
+  // humidity converted to the temperature compensated for self-heating,
+  // logged readings with all offsets the model may predict
+  for (uint16_t i = 0; i < readings; i++) {
+    for (int16_t offset = 0; offset <= 500; offset += 10) {
+      humNew = (uint64_t(humidity[i] * 100) * magnusRatio(temperature[i],
+        temperature[i] - offset) + 32768) >> 16;
+      humNew = min((humNew + 50) / 100, uint32_t(100));
+      humOld = min(lroundf(humidity[i] * magnus(temperature[i]) /
+        magnus(temperature[i] - offset)), 100L);
+      CHECK(abs(int32_t(humNew) - humOld) <= 1);
+      if (int32_t(humNew) != humOld)
+        humMismatch++;
+    }
+  }
+  CHECK(humMismatch * 100 <= readings * 51);  // less than 1% off by one
+
+  tFloat = timeit(stdDevFloat, SCD30_NUM_SAMPLES_MEDIAN, &sum);
+  tInt = timeit([](RunningMedian &r) { return stdDev(r, false); },
+    SCD30_NUM_SAMPLES_MEDIAN, &sum);
+  printf("stdDev per sample: float %uns, integer %uns, humidity off by one %u/%u\n",
+    tFloat, tInt, humMismatch, readings * 51);
+  CHECK(sum > 0);
+
+  return testResult("fixedpoint");
+}
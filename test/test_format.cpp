@@ -0,0 +1,163 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+
+#include "test.h"
+#include "format.h"
+#include <chrono>
+
+// bit-exactness of the integer formatters against printf(), which
+// formats like dtostrf() used before for JSON, MQTT and the web ui;
+// also times a log line built both ways (host timings, the ESP8266
+// has no FPU, so the gap there is larger)
+
+#define ROUNDS 200000
+
+static char buf[32], ref[32];
+
+
+// dtostrf() as in the ESP8266 core, right aligned to width
+static char* dtostrf(double value, int width, int prec, char *s) {
+  sprintf(s, "%*.*f", width, prec, value);
+  return s;
+}
+
+
+// removed from utils.cpp, stripped the padding of dtostrf()
+static char* removeSpaces(char *str) {
+  uint8_t i = 0, j = 0;
+  while (str[i++]) {
+    if (str[i-1] != ' ')
+      str[j++] = str[i-1];
+  }
+  str[j] = '\0';
+  return str;
+}
+
+
+// CSV line of logReadings(): co2, temperature, humidity, vbat
+static char* logLineOld(char *line, uint16_t co2, int16_t temp, uint8_t hum, uint16_t vbat) {
+  char s[16];
+
+  sprintf(line, "%d,", co2);
+  dtostrf(temp / 100.0, 6, 2, s);
+  removeSpaces(s);
+  strcat(line, s);
+  sprintf(s, ",%d,", hum);
+  strcat(line, s);
+  dtostrf(vbat / 1000.0, 4, 2, s);
+  removeSpaces(s);
+  strcat(line, s);
+  return line;
+}
+
+
+static char* logLineNew(char *line, uint16_t co2, int16_t temp, uint8_t hum, uint16_t vbat) {
+  char *p = line;
+
+  p = fmt_uint(p, co2);
+  p = fmt_char(p, ',');
+  p = fmt_fixed(p, temp, 2, 2);
+  p = fmt_char(p, ',');
+  p = fmt_uint(p, hum);
+  p = fmt_char(p, ',');
+  fmt_fixed(p, vbat, 3, 2);
+  return line;
+}
+
+
+// nanosecs per line, summed length keeps the calls from being dropped
+template<typename F>
+static uint32_t timeit(F f, size_t *len) {
+  static char line[64];
+  auto start = std::chrono::steady_clock::now();
+
+  for (uint32_t i = 0; i < ROUNDS; i++)
+    *len += strlen(f(line, 400 + i % 2000, -500 + i % 3000, i % 100, 3500 + i % 700));
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - start).count() / ROUNDS;
+}
+
+
+int main() {
+  const int32_t ints[] = { 0, 1, -1, 9, 10, -10, 99, 65535, 65536, -32768,
+    INT32_MAX, INT32_MIN + 1, INT32_MIN };
+  const uint32_t uints[] = { 0, 1, 9, 10, 4294967295U, 1000000000U };
+  char *end;
+
+  for (int32_t v : ints) {
+    end = fmt_int(buf, v);
+    snprintf(ref, sizeof(ref), "%ld", (long) v);
+    CHECK_STR(buf, ref);
+    CHECK_EQ(end - buf, strlen(ref));
+  }
+  for (uint32_t v : uints) {
+    end = fmt_uint(buf, v);
+    snprintf(ref, sizeof(ref), "%lu", (unsigned long) v);
+    CHECK_STR(buf, ref);
+    CHECK_EQ(end - buf, strlen(ref));
+  }
+
+  // all int16 values at their native two decimals, e.g. temperatures
+  // in centi-°C as written to JSON
+  for (int32_t v = INT16_MIN; v <= INT16_MAX; v++) {
+    end = fmt_fixed(buf, v, 2, 2);
+    snprintf(ref, sizeof(ref), "%.2f", v / 100.0);
+    CHECK_STR(buf, ref);
+    CHECK_EQ(end - buf, strlen(ref));
+  }
+
+  // more decimals than scale are padded with zeros
+  for (int32_t v = -2000; v <= 2000; v++) {
+    fmt_fixed(buf, v, 1, 3);
+    snprintf(ref, sizeof(ref), "%.3f", v / 10.0);
+    CHECK_STR(buf, ref);
+    fmt_fixed(buf, v, 0, 0);
+    snprintf(ref, sizeof(ref), "%ld", (long) v);
+    CHECK_STR(buf, ref);
+  }
+
+  // fewer decimals round half away from zero like dtostrf(),
+  // printf() rounds exact halves to even
+  fmt_fixed(buf, 25, 2, 1);
+  CHECK_STR(buf, "0.3");
+  fmt_fixed(buf, -25, 2, 1);
+  CHECK_STR(buf, "-0.3");
+  fmt_fixed(buf, 2195, 2, 1);
+  CHECK_STR(buf, "22.0");
+  fmt_fixed(buf, 2194, 2, 1);
+  CHECK_STR(buf, "21.9");
+  fmt_fixed(buf, 99950, 3, 1);
+  CHECK_STR(buf, "100.0");
+  fmt_fixed(buf, -4, 2, 1);
+  CHECK_STR(buf, "-0.0");
+
+  end = fmt_char(buf, 'x');
+  CHECK_STR(buf, "x");
+  CHECK_EQ(end - buf, 1);
+
+  // both ways yield the same log line
+  char line[64];
+  size_t len = 0;
+  CHECK_STR(logLineNew(line, 1234, -1050, 45, 3987), "1234,-10.50,45,3.99");
+  CHECK_STR(logLineOld(line, 1234, -1050, 45, 3987), "1234,-10.50,45,3.99");
+  for (int32_t t = -4000; t <= 6000; t += 7) {
+    logLineOld(ref, 800, t, 50, 4000 + t % 10 * 10);
+    CHECK_STR(logLineNew(line, 800, t, 50, 4000 + t % 10 * 10), ref);
+  }
+
+  uint32_t tOld = timeit(logLineOld, &len);
+  uint32_t tNew = timeit(logLineNew, &len);
+  printf("log line: dtostrf/sprintf %uns, fmt_* %uns\n", tOld, tNew);
+  CHECK(len > 0);
+  CHECK(tNew < tOld);
+
+  return testResult("format");
+}
@@ -0,0 +1,173 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "test.h"
+#include "snapshot.h"
+#include <chrono>
+#ifdef HAVE_ARDUINOJSON
+#include <ArduinoJson.h>
+#endif
+
+// output of the compile-time JSON writer and its worst case size; the
+// snapshot schema is timed against ArduinoJson if its source directory
+// is given, e.g. make ARDUINOJSON=~/Arduino/libraries/ArduinoJson/src
+
+#define ROUNDS 100000
+
+namespace jsonkey {
+  JSON_KEY(s); JSON_KEY(f); JSON_KEY(n);
+}
+
+typedef json::Object<
+  json::Field<jsonkey::s, json::Str<8>>,
+  json::Optional<jsonkey::f, json::Fixed<2,2>>,
+  json::Optional<jsonkey::n, json::Int16>
+> testJSON;
+
+// braces, two commas, three keys with quotes and colons, values
+static_assert(testJSON::size == 2 + 2 + 3 * 4 + (6 * 8 + 2) + 7 + 6 + 1, "schema size");
+
+#ifdef JSON_BUFFER_TOO_SMALL
+// must not compile, see Makefile
+static void tooSmall() {
+  char buf[testJSON::size - 1];
+  testJSON::write(buf, "", json::maybe(int16_t(0), false), json::maybe(int16_t(0), false));
+}
+#endif
+
+
+static size_t writeSnapshot(char (&buf)[snapshotJSON::size], const snapshot_t &s) {
+  return snapshotJSON::write(buf,
+    json::maybe("0a1b2c", true),
+    json::maybe(s.timestamp, true),
+    json::maybe(s.co2ppm, true),
+    json::maybe(s.temperature, true),
+    json::maybe(s.humidity, true),
+    json::maybe(s.pressure, true),
+    "MEDIUM",
+    int16_t(s.vbat / 10),
+    json::maybe(s.soc, true),
+    json::maybe(s.runtime, true),
+    json::maybe(s.trend, true),
+    json::maybe(s.forecast, true),
+    json::maybe(s.ach, true));
+}
+
+
+#ifdef HAVE_ARDUINOJSON
+// same fields as built with ArduinoJson before
+static size_t arduinoSnapshot(char (&buf)[snapshotJSON::size], const snapshot_t &s) {
+  StaticJsonDocument<JSON_OBJECT_SIZE(13)> doc;
+
+  doc["device"] = "0a1b2c";
+  doc["ts"] = s.timestamp;
+  doc["co2median"] = s.co2ppm;
+  doc["temperature"] = s.temperature / 100.0;
+  doc["humidity"] = s.humidity;
+  doc["pressure"] = s.pressure;
+  doc["co2status"] = "MEDIUM";
+  doc["vbat"] = (s.vbat / 10) / 100.0;
+  doc["soc"] = s.soc;
+  doc["runtime"] = s.runtime;
+  doc["trend"] = s.trend;
+  doc["forecast"] = s.forecast;
+  doc["ach"] = s.ach / 10.0;
+  return serializeJson(doc, buf, sizeof(buf));
+}
+#endif
+
+
+// nanosecs per call, readings change every round
+template<typename F>
+static uint32_t timeit(F f, snapshot_t &s, size_t *len) {
+  static char buf[snapshotJSON::size];
+  auto start = std::chrono::steady_clock::now();
+
+  for (uint32_t i = 0; i < ROUNDS; i++) {
+    s.co2ppm = 400 + i % 2000;
+    s.temperature = 1800 + i % 700;
+    s.timestamp = 1609459200 + i;
+    *len += f(buf, s);
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - start).count() / ROUNDS;
+}
+
+
+int main() {
+  char buf[testJSON::size], snap[snapshotJSON::size];
+  snapshot_t s = {};
+  size_t len = 0;
+
+  // optional fields are omitted without leaving commas behind
+  testJSON::write(buf, "ok", json::maybe(int16_t(2150), true), json::maybe(int16_t(-3), true));
+  CHECK_STR(buf, "{\"s\":\"ok\",\"f\":21.50,\"n\":-3}");
+  testJSON::write(buf, "ok", json::maybe(int16_t(0), false), json::maybe(int16_t(7), true));
+  CHECK_STR(buf, "{\"s\":\"ok\",\"n\":7}");
+  testJSON::write(buf, "ok", json::maybe(int16_t(0), false), json::maybe(int16_t(0), false));
+  CHECK_STR(buf, "{\"s\":\"ok\"}");
+
+  // escaping of quotes, backslashes and control chars, truncated to N
+  testJSON::write(buf, "a\"b\\c\n\x01\x1f", json::maybe(int16_t(0), false),
+    json::maybe(int16_t(0), false));
+  CHECK_STR(buf, "{\"s\":\"a\\\"b\\\\c\\u000a\\u0001\\u001f\"}");
+  testJSON::write(buf, "0123456789", json::maybe(int16_t(0), false), json::maybe(int16_t(0), false));
+  CHECK_STR(buf, "{\"s\":\"01234567\"}");
+
+  // negative fixed-point values
+  testJSON::write(buf, "", json::maybe(int16_t(-5), true), json::maybe(int16_t(0), false));
+  CHECK_STR(buf, "{\"s\":\"\",\"f\":-0.05}");
+  testJSON::write(buf, "", json::maybe(int16_t(-1234), true), json::maybe(int16_t(0), false));
+  CHECK_STR(buf, "{\"s\":\"\",\"f\":-12.34}");
+  s.ach = -7;
+  snapshotJSON::write(snap, json::maybe("", false), json::maybe(0U, false),
+    json::maybe(uint16_t(0), false), json::maybe(int16_t(-1050), true),
+    json::maybe(uint8_t(0), false), json::maybe(uint16_t(0), false), "GOOD",
+    int16_t(-1), json::maybe(uint8_t(0), false), json::maybe(int16_t(0), false),
+    json::maybe(int16_t(0), false), json::maybe(int16_t(0), false),
+    json::maybe(s.ach, true));
+  CHECK_STR(snap, "{\"temperature\":-10.50,\"co2status\":\"GOOD\",\"vbat\":-0.01,\"ach\":-0.7}");
+
+  // worst case fills the buffer computed at compile time exactly
+  CHECK_EQ(testJSON::write(buf, "\x01\x01\x01\x01\x01\x01\x01\x01",
+    json::maybe(int16_t(INT16_MIN), true), json::maybe(int16_t(INT16_MIN), true)),
+    testJSON::size - 1);
+  CHECK_STR(buf, "{\"s\":\"\\u0001\\u0001\\u0001\\u0001\\u0001\\u0001\\u0001\\u0001\","
+    "\"f\":-327.68,\"n\":-32768}");
+
+  // snapshot schema as published via REST and MQTT
+  s.co2ppm = 1234;
+  s.temperature = 2150;
+  s.humidity = 45;
+  s.pressure = 1013;
+  s.vbat = 3987;
+  s.soc = 80;
+  s.runtime = 12;
+  s.trend = -250;
+  s.forecast = 42;
+  s.ach = 35;
+  s.timestamp = 1609459200;
+  writeSnapshot(snap, s);
+  CHECK_STR(snap, "{\"device\":\"0a1b2c\",\"ts\":1609459200,\"co2median\":1234,"
+    "\"temperature\":21.50,\"humidity\":45,\"pressure\":1013,\"co2status\":\"MEDIUM\","
+    "\"vbat\":3.98,\"soc\":80,\"runtime\":12,\"trend\":-250,\"forecast\":42,\"ach\":3.5}");
+
+  printf("snapshot JSON (%u bytes max.): writer %uns", unsigned(snapshotJSON::size),
+    timeit(writeSnapshot, s, &len));
+#ifdef HAVE_ARDUINOJSON
+  printf(", ArduinoJson %uns", timeit(arduinoSnapshot, s, &len));
+#else
+  printf(", ArduinoJson not given (make ARDUINOJSON=<src dir>)");
+#endif
+  printf("\n");
+  CHECK(len > 0);
+
+  return testResult("jsonwriter");
+}
@@ -0,0 +1,234 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "test.h"
+#include "kalman.h"
+#include "config.h"
+#include "sensors.h"
+
+// Kalman filter against the median of the last SCD30_NUM_SAMPLES_MEDIAN
+// readings on synthetic lessons: steady level, linear rise while people
+// are in the room, then ventilation; latency is the delay of a status
+// change behind the true level, extra transitions are those caused by
+// noise and spikes; with a sensor.log as argument its readings are
+// replayed and both filters are printed instead
+
+#define RUNS 100
+
+typedef struct {
+  int32_t latency[2];  // secs for medium and high threshold
+  int32_t transitions;
+} filterstats_t;
+
+
+static uint32_t lcg() {
+  static uint32_t seed = 1;
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+
+// approx. normal noise with given sigma (sum of three uniforms)
+static float noise(float sigma) {
+  float sum = 0;
+  for (uint8_t i = 0; i < 3; i++)
+    sum += lcg() % 1001 / 1000.0 - 0.5;
+  return sum * 2 * sigma;
+}
+
+
+// status 0-2 with hysteresis like the LEDs
+static uint8_t status(uint8_t s, uint16_t ppm) {
+  if (ppm >= CO2_HIGH_THRESHOLD)
+    return 2;
+  if (ppm >= CO2_MEDIUM_THRESHOLD && s < 1)
+    return 1;
+  if (s == 2 && ppm < CO2_HIGH_THRESHOLD - CO2_THRESHOLD_HYSTERESIS)
+    s = 1;
+  if (s == 1 && ppm < CO2_MEDIUM_THRESHOLD - CO2_THRESHOLD_HYSTERESIS)
+    s = 0;
+  return s;
+}
+
+
+// median of last readings, mean of middle two for even count
+static uint16_t median(const uint16_t *readings, uint8_t n) {
+  uint16_t s[SCD30_NUM_SAMPLES_MEDIAN];
+
+  memcpy(s, readings, n * sizeof(uint16_t));
+  for (uint8_t i = 1; i < n; i++)  // insertion sort
+    for (uint8_t j = i; j > 0 && s[j-1] > s[j]; j--)
+      std::swap(s[j-1], s[j]);
+  return (n % 2) ? s[n/2] : (s[n/2-1] + s[n/2]) / 2;
+}
+
+
+// one lesson per run with random slope, 4 hours each
+static void lessons(uint16_t intervalSecs, uint8_t samples, float spikeRate,
+    filterstats_t *med, filterstats_t *kal) {
+  uint16_t readings[SCD30_NUM_SAMPLES_MEDIAN], co2, ppm[3];
+  uint8_t n, s, st[3];
+  uint16_t trans[3];
+  uint32_t cross[3][2];
+  float slope, truth, top;
+  filterstats_t *f;
+
+  memset(med, 0, sizeof(*med));
+  memset(kal, 0, sizeof(*kal));
+  for (uint16_t run = 0; run < RUNS; run++) {
+    slope = 5 + lcg() % 41;  // ppm/min
+    top = min(600 + slope * 110, 1800.0f);
+    memset(st, 0, sizeof(st));
+    memset(trans, 0, sizeof(trans));
+    memset(cross, 0, sizeof(cross));
+    kalman_reset();
+    n = 0;
+
+    for (uint32_t t = 0; t < 4 * 3600; t += intervalSecs) {
+      testMillis = (run * 4 * 3600 + t) * 1000;
+      if (t < 600)
+        truth = 600;
+      else if (t < 7200)
+        truth = min(600 + slope * (t - 600) / 60, top);
+      else
+        truth = 450 + (top - 450) * expf((7200.0f - t) / 480);
+      co2 = lroundf(truth + noise(8));
+      if (lcg() % 1000 < spikeRate * 1000)
+        co2 += 300 + lcg() % 500;
+
+      if (n == samples)
+        memmove(readings, readings + 1, --n * sizeof(uint16_t));
+      readings[n++] = co2;
+      kalman_add(co2);
+
+      ppm[0] = lroundf(truth);
+      ppm[1] = median(readings, n);
+      ppm[2] = kalman_ppm();
+      for (uint8_t k = 0; k < 3; k++) {
+        s = status(st[k], ppm[k]);
+        if (s != st[k])
+          trans[k]++;
+        if (s > st[k] && !cross[k][s-1])
+          cross[k][s-1] = t;
+        st[k] = s;
+      }
+    }
+
+    for (uint8_t k = 1; k < 3; k++) {
+      f = (k == 1) ? med : kal;
+      f->transitions += trans[k] - trans[0];
+      for (uint8_t j = 0; j < 2; j++)
+        if (cross[0][j] && cross[k][j])
+          f->latency[j] += int32_t(cross[k][j] - cross[0][j]);
+    }
+  }
+}
+
+
+// logged readings with median and Kalman estimate as CSV, the logging
+// interval is taken as reading interval
+static void replayLog(const char *filename) {
+  FILE *f = fopen(filename, "r");
+  char line[160];
+  unsigned runtime, co2;
+  uint16_t readings[SCD30_NUM_SAMPLES_MEDIAN], ppm[2];
+  uint8_t n = 0, st[2] = { 0, 0 }, s;
+  uint16_t trans[2] = { 0, 0 };
+
+  if (!f) {
+    printf("cannot open %s\n", filename);
+    exit(1);
+  }
+  printf("runtime,co2,median,kalman\n");
+  while (fgets(line, sizeof(line), f)) {
+    // timestamp,runtime,status,co2,... as written by logReadings()
+    if (sscanf(line, "%*[^,],%u,%*[^,],%u", &runtime, &co2) != 2)
+      continue;
+    if (runtime * 1000 < testMillis) {  // device rebooted
+      kalman_reset();
+      n = 0;
+    }
+    testMillis = runtime * 1000;
+    if (n == SCD30_NUM_SAMPLES_MEDIAN)
+      memmove(readings, readings + 1, --n * sizeof(uint16_t));
+    readings[n++] = co2;
+    if (co2 > CO2_LOWER_BOUND)
+      kalman_add(co2);
+    else
+      kalman_reset();  // like scd30_readings()
+
+    ppm[0] = median(readings, n);
+    ppm[1] = kalman_ppm();
+    for (uint8_t k = 0; k < 2; k++) {
+      s = status(st[k], ppm[k]);
+      if (s != st[k])
+        trans[k]++;
+      st[k] = s;
+    }
+    printf("%u,%u,%u,%u\n", runtime, co2, ppm[0], ppm[1]);
+  }
+  printf("status transitions: median %u, kalman %u\n", trans[0], trans[1]);
+  fclose(f);
+}
+
+
+int main(int argc, char *argv[]) {
+  filterstats_t med, kal;
+
+  if (argc > 1) {
+    replayLog(argv[1]);
+    return 0;
+  }
+
+  // basic behaviour
+  kalman_reset();
+  CHECK_EQ(kalman_ppm(), 0);
+  testMillis = 1000000;
+  kalman_add(800);
+  CHECK_EQ(kalman_ppm(), 800);
+  testMillis += 10000;
+  kalman_add(1600);  // single spike is skipped
+  CHECK(kalman_ppm() < 820);
+  for (uint8_t i = 0; i < KALMAN_GATE_MAX; i++) {  // step is taken
+    testMillis += 10000;
+    kalman_add(1600);
+  }
+  CHECK(kalman_ppm() >= 1580 && kalman_ppm() <= 1620);
+  kalman_reset();  // e.g. invalid reading
+  CHECK_EQ(kalman_ppm(), 0);
+
+  // default interval, sensor noise only
+  lessons(SCD30_INTERVAL_SECS, SCD30_NUM_SAMPLES_MEDIAN, 0, &med, &kal);
+  printf("median latency %d/%ds, kalman %d/%ds, extra transitions %d/%d\n",
+    med.latency[0] / RUNS, med.latency[1] / RUNS, kal.latency[0] / RUNS,
+    kal.latency[1] / RUNS, med.transitions, kal.transitions);
+  CHECK(kal.latency[0] < med.latency[0]);
+  CHECK(kal.latency[1] < med.latency[1]);
+  CHECK(kal.transitions <= med.transitions + RUNS / 10);
+
+  // with 1% spikes
+  lessons(SCD30_INTERVAL_SECS, SCD30_NUM_SAMPLES_MEDIAN, 0.01, &med, &kal);
+  printf("with spikes: median latency %d/%ds, kalman %d/%ds, extra transitions %d/%d\n",
+    med.latency[0] / RUNS, med.latency[1] / RUNS, kal.latency[0] / RUNS,
+    kal.latency[1] / RUNS, med.transitions, kal.transitions);
+  CHECK(kal.latency[1] < med.latency[1]);
+  CHECK(kal.transitions <= med.transitions + RUNS / 10);
+
+  // low power mode, readings are sparse, so no slack for extra transitions
+  lessons(SCD30_LOWPOWER_INTERVAL_SECS, SCD30_LOWPOWER_SAMPLES_MEDIAN, 0.01, &med, &kal);
+  printf("low power: median latency %d/%ds, kalman %d/%ds, extra transitions %d/%d\n",
+    med.latency[0] / RUNS, med.latency[1] / RUNS, kal.latency[0] / RUNS,
+    kal.latency[1] / RUNS, med.transitions, kal.transitions);
+  CHECK(kal.latency[0] < med.latency[0]);
+  CHECK(kal.latency[1] < med.latency[1]);
+  CHECK(kal.transitions <= med.transitions);
+
+  return testResult("kalman");
+}
@@ -0,0 +1,99 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "test.h"
+#include "scheduler.h"
+#include "sensors.h"
+#include "rtc.h"
+
+// NOOP windows across DST changes (last Sunday of March and October)
+
+sysprefs_t settings;
+sensorStatus co2status;
+TimeChangeRule CEST = {"CEST", Last, Sun, Mar, 2, 120};
+TimeChangeRule CET = {"CET ", Last, Sun, Oct, 3, 60};
+Timezone CE(CEST, CET);
+static uint32_t now;
+
+uint32_t rtc_now() { return now; }
+void logMsg(char*) {}
+
+
+// UTC epoch of local time with given UTC offset
+static uint32_t utcOf(int y, int m, int d, int hh, int mm, int offsetHours) {
+  tmElements_t e = {};
+
+  e.Year = y - 1970;
+  e.Month = m;
+  e.Day = d;
+  e.Hour = hh;
+  e.Minute = mm;
+  return makeTime(e) - offsetHours * SECS_PER_HOUR;
+}
+
+
+// returns true if in NOOP window at given time, status is reset
+// before so windows are checked independently
+static bool noopAt(uint32_t utc, uint8_t begin, uint8_t end) {
+  now = utc;
+  co2status = GOOD;
+  return checkNOOPTime(begin, end);
+}
+
+
+int main() {
+  settings.enableNOOP = true;
+
+  // plain winter night 22-06 CET
+  CHECK(!noopAt(utcOf(2021, 1, 15, 21, 59, 1) + 59, 22, 6));
+  CHECK(noopAt(utcOf(2021, 1, 15, 22, 0, 1), 22, 6));
+  CHECK_EQ(noopRemainingSecs(), 8 * SECS_PER_HOUR);
+  CHECK_EQ(co2status, NOOP);
+  CHECK(noopAt(utcOf(2021, 1, 16, 5, 59, 1), 22, 6));
+  CHECK(!noopAt(utcOf(2021, 1, 16, 6, 0, 1), 22, 6));
+
+  // night with change to summer time is an hour shorter
+  CHECK(noopAt(utcOf(2021, 3, 27, 22, 0, 1), 22, 6));
+  CHECK_EQ(noopRemainingSecs(), 7 * SECS_PER_HOUR);
+  CHECK(noopAt(utcOf(2021, 3, 28, 5, 59, 2), 22, 6));
+  CHECK(!noopAt(utcOf(2021, 3, 28, 6, 0, 2), 22, 6));
+
+  // night with change to winter time is an hour longer
+  CHECK(noopAt(utcOf(2021, 10, 30, 22, 0, 2), 22, 6));
+  CHECK_EQ(noopRemainingSecs(), 9 * SECS_PER_HOUR);
+  CHECK(noopAt(utcOf(2021, 10, 31, 5, 59, 1), 22, 6));
+  CHECK(!noopAt(utcOf(2021, 10, 31, 6, 0, 1), 22, 6));
+
+  // window spanning the change itself, 01:00 CET to 05:00 CEST
+  CHECK(!noopAt(utcOf(2021, 3, 28, 0, 59, 1), 1, 5));
+  CHECK(noopAt(utcOf(2021, 3, 28, 1, 0, 1), 1, 5));
+  CHECK_EQ(noopRemainingSecs(), 3 * SECS_PER_HOUR);
+
+  // 02:00 is skipped in spring, window starts with the change to 03:00
+  CHECK(!noopAt(utcOf(2021, 3, 28, 1, 59, 1), 2, 4));
+  CHECK(noopAt(utcOf(2021, 3, 28, 3, 0, 2), 2, 4));
+  CHECK_EQ(noopRemainingSecs(), SECS_PER_HOUR);
+
+  // 02:00 occurs twice in autumn, window starts with the first
+  CHECK(!noopAt(utcOf(2021, 10, 31, 1, 59, 2), 2, 4));
+  CHECK(noopAt(utcOf(2021, 10, 31, 2, 0, 2), 2, 4));
+  CHECK_EQ(noopRemainingSecs(), 3 * SECS_PER_HOUR);
+
+  // summer day window without DST change
+  CHECK(!noopAt(utcOf(2021, 7, 1, 11, 59, 2), 12, 14));
+  CHECK(noopAt(utcOf(2021, 7, 1, 12, 0, 2), 12, 14));
+  CHECK_EQ(noopRemainingSecs(), 2 * SECS_PER_HOUR);
+
+  // disabled schedule
+  settings.enableNOOP = false;
+  CHECK(!noopAt(utcOf(2021, 1, 15, 23, 0, 1), 22, 6));
+
+  return testResult("scheduler");
+}
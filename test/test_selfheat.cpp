@@ -0,0 +1,95 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "test.h"
+#include "selfheat.h"
+#include "led.h"
+#include "rtc.h"
+
+// self-heating model on a synthetic device with known heating per
+// input, power state changes every few hours like during office use
+
+uEEPROMLib rtceeprom(0x57);
+bool i2c_present(i2cDevices) { return false; }  // no EEPROM
+uint32_t i2c_begin(i2cDevices) { return 0; }
+bool i2c_end(i2cDevices, uint32_t, bool success) { return success; }
+uint16_t crc16(const uint8_t*, uint8_t) { return 0; }
+void logMsg(char*) { }
+
+static const float heating[SELFHEAT_INPUTS] = { 150, 60, 40, 80 };  // centi-°C
+
+
+// simple deterministic noise in [-amp, amp]
+static int16_t noise(int16_t amp) {
+  static uint32_t seed = 1;
+  seed = seed * 1103515245 + 12345;
+  return int16_t((seed >> 16) % (2 * amp + 1)) - amp;
+}
+
+
+// runs device for given days with a reading every 10 secs, returns
+// max. error of predicted self-heating (centi-°C) on the last day
+static int16_t run(uint32_t startSecs, uint16_t days, int16_t amp) {
+  float lag[SELFHEAT_INPUTS] = { 1, 1, 0, 0.2 }, x[SELFHEAT_INPUTS], r;
+  int16_t maxError = 0;
+  uint8_t hour, leds;
+  uint16_t interval;
+  bool wifi;
+
+  for (uint32_t t = 1; t < days * 86400UL; t++) {
+    testMillis = (startSecs + t) * 1000;
+    hour = (t / 3600) % 24;
+    wifi = (hour % 5) < 2;
+    leds = (hour % 3 == 0) ? NUM_PIXELS : (hour % 3 == 1 ? 4 : 0);
+    interval = (hour % 7 < 3) ? 2 : 10;
+    x[0] = 1;
+    x[1] = wifi;
+    x[2] = float(leds) / NUM_PIXELS;
+    x[3] = 2.0 / interval;
+
+    // housing warms up with time constant of the model
+    r = 0;
+    for (uint8_t i = 0; i < SELFHEAT_INPUTS; i++) {
+      lag[i] += (x[i] - lag[i]) / SELFHEAT_TAU_SECS;
+      r += heating[i] * lag[i];
+    }
+    selfheat_inputs(wifi, leds, interval);
+    if (!(t % 10)) {
+      selfheat_learn(lroundf(r) + noise(amp));
+      if (t > (days - 1) * 86400UL)
+        maxError = max(maxError, int16_t(abs(selfheat_offset() - lroundf(r))));
+    }
+  }
+  return maxError;
+}
+
+
+int main() {
+  selfheat_reset();
+  CHECK_EQ(selfheat_offset(), 0);
+
+  // noise free, learned within a day
+  CHECK(run(0, 2, 0) <= 2);
+
+  // with noise of paired readings, after two days and after three
+  // weeks (covariance stays bounded and positive)
+  selfheat_reset();
+  CHECK(run(1000000, 2, 15) <= 10);
+  CHECK(run(2000000, 21, 15) <= 10);
+  saveSelfheat();  // logs coefficients
+
+  // offset is limited
+  selfheat_reset();
+  for (uint16_t i = 0; i < 1000; i++)
+    selfheat_learn(SELFHEAT_OFFSET_MAX * 3);
+  CHECK_EQ(selfheat_offset(), SELFHEAT_OFFSET_MAX);
+
+  return testResult("selfheat");
+}
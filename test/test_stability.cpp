@@ -0,0 +1,92 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+#include "test.h"
+#include "stability.h"
+#include "sensors.h"
+
+// calibration on synthetic settling curves: first order step response
+// from room air down to outdoor level with sensor noise, one reading
+// per SCD30_CALIBRATION_INTERVAL_SECS like in scd30_calibrate()
+
+
+// simple deterministic noise in [-amp, amp]
+static int16_t noise(int16_t amp) {
+  static uint32_t seed = 1;
+  seed = seed * 1103515245 + 12345;
+  return int16_t((seed >> 16) % (2 * amp + 1)) - amp;
+}
+
+
+// secs until readings are stable, 0 on timeout; mean of window returned
+static uint16_t settle(float tau, float step, float driftPerMin, int16_t amp,
+    uint16_t *mean) {
+  float t, c;
+
+  stability_reset();
+  for (t = 0; t <= SCD30_CALIBRATION_SECS; t += SCD30_CALIBRATION_INTERVAL_SECS) {
+    c = SCD30_CO2_CALIBRATION_VALUE + step * expf(-t / tau) + driftPerMin * t / 60;
+    stability_add(lroundf(c) + noise(amp));
+    if (stability_check(SCD30_CALIBRATION_INTERVAL_SECS,
+        SCD30_CALIBRATION_SIGMA_MAX, SCD30_CALIBRATION_DRIFT_MAX)) {
+      *mean = stability_mean();
+      return t;
+    }
+  }
+  return 0;
+}
+
+
+int main() {
+  uint16_t secs, mean;
+
+  // bounds are only known once the window is full
+  stability_reset();
+  for (uint8_t i = 0; i < STABILITY_WINDOW - 1; i++)
+    stability_add(SCD30_CO2_CALIBRATION_VALUE);
+  CHECK(!stability_ready());
+  CHECK(!stability_check(2, 300, 300));
+  stability_add(SCD30_CO2_CALIBRATION_VALUE);
+  CHECK(stability_check(2, 300, 300));
+  CHECK_EQ(stability_sigma(), 0);
+  CHECK_EQ(stability_drift(), 0);
+
+  // running sums match after the window wrapped many times
+  for (uint16_t i = 0; i < 1000; i++)
+    stability_add(400 + i % 7);
+  CHECK_EQ(stability_mean(), (400 * 30 + 4 * 3 + 21 * 4) / 30);
+
+  // settled readings are accepted right away
+  secs = settle(1, 0, 0, 2, &mean);
+  CHECK(secs > 0 && secs <= STABILITY_WINDOW * SCD30_CALIBRATION_INTERVAL_SECS);
+
+  // fast settling, sensor taken outside with a 600ppm step
+  secs = settle(5, 600, 0, 2, &mean);
+  CHECK(secs > 0 && secs <= 120);
+  CHECK(abs(mean - SCD30_CO2_CALIBRATION_VALUE) <= 2);
+
+  // slow settling still finishes within timeout without remaining error
+  secs = settle(20, 600, 0, 2, &mean);
+  CHECK(secs > 0 && secs <= 200);
+  CHECK(abs(mean - SCD30_CO2_CALIBRATION_VALUE) <= 2);
+  secs = settle(40, 600, 0, 2, &mean);
+  CHECK(secs > 0);
+  CHECK(abs(mean - SCD30_CO2_CALIBRATION_VALUE) <= 2);
+
+  // steady drift (e.g. people nearby) or noisy readings time out; while
+  // still settling a rising concentration can pass briefly where both
+  // slopes cancel, the window is too short to tell
+  CHECK_EQ(settle(1, 0, 5, 2, &mean), 0);
+  CHECK(stability_drift() > SCD30_CALIBRATION_DRIFT_MAX);
+  CHECK_EQ(settle(5, 600, 0, 10, &mean), 0);
+  CHECK(stability_sigma() > SCD30_CALIBRATION_SIGMA_MAX);
+
+  return testResult("stability");
+}
@@ -0,0 +1,176 @@
+/***************************************************************************
+  Copyright (c) 2020-2021 Lars Wessels
+
+  This file a part of the "CO2-Ampel" source code.
+  https://github.com/lrswss/co2ampel
+
+  Published under Apache License 2.0
+
+***************************************************************************/
+
+
+#include "test.h"
+#include "ventilation.h"
+#include "logging.h"
+
+#define ROOMS 9
+
+// ventilation events on synthetic mass balance traces with known air
+// changes per hour; with a sensor.log as argument its readings are
+// replayed and detected events are printed instead ('make' compares
+// the events of test/sensor.log with test/sensor.events)
+
+static uint16_t events = 0;
+static bool replay = false;
+
+void logMsg(char *msg) {
+  if (replay)
+    printf("%s\n", msg);
+  events++;
+}
+
+
+// simple deterministic noise in [-amp, amp]
+static int16_t noise(int16_t amp) {
+  static uint32_t seed = 1;
+  seed = seed * 1103515245 + 12345;
+  return int16_t((seed >> 16) % (2 * amp + 1)) - amp;
+}
+
+
+// room with constant CO2 emission (ppm/h), air changes per hour
+// switch to ach during ventilation at given time and duration;
+// readings every intervalSecs with given noise
+static void room(uint32_t startSecs, uint32_t ventSecs, uint32_t ventDuration,
+    float ach, float emission, uint16_t intervalSecs, int16_t amp) {
+  float c = 1400, a;
+
+  for (uint32_t t = 0; t < ventSecs + ventDuration + 1800; t++) {
+    a = (t >= ventSecs && t < ventSecs + ventDuration) ? ach : 0.1;
+    c += (emission - a * (c - VENT_OUTDOOR_PPM)) / 3600;
+    if (!(t % intervalSecs)) {
+      testMillis = (startSecs + t) * 1000;
+      ventilation_add(lroundf(c) + noise(amp));
+    }
+  }
+}
+
+
+// single fits scatter by up to 50% with noisy readings, so the
+// same ventilation is repeated and the median ach is returned
+static int16_t medianACH(uint32_t startSecs, uint32_t ventDuration,
+    float ach, float emission, uint16_t intervalSecs, int16_t amp, uint8_t *logged) {
+  int16_t achs[ROOMS];
+  uint16_t e;
+
+  *logged = 0;
+  for (uint8_t i = 0; i < ROOMS; i++) {
+    e = events;
+    room(startSecs + i * 10000, 1800, ventDuration, ach, emission, intervalSecs, amp);
+    achs[*logged] = ventilation_ach();
+    if (events > e)
+      (*logged)++;
+  }
+  ventilation_reset();
+  if (!*logged)
+    return -1;
+  for (uint8_t i = 1; i < *logged; i++)  // insertion sort
+    for (uint8_t j = i; j > 0 && achs[j-1] > achs[j]; j--)
+      std::swap(achs[j-1], achs[j]);
+  return achs[*logged / 2];
+}
+
+
+static void replayLog(const char *filename) {
+  FILE *f = fopen(filename, "r");
+  char line[160];
+  unsigned runtime, co2;
+
+  if (!f) {
+    printf("cannot open %s\n", filename);
+    exit(1);
+  }
+  replay = true;
+  while (fgets(line, sizeof(line), f)) {
+    // timestamp,runtime,status,co2,... as written by logReadings()
+    if (sscanf(line, "%*[^,],%u,%*[^,],%u", &runtime, &co2) != 2 || co2 <= 350)
+      continue;
+    if (runtime * 1000 < testMillis)  // device rebooted
+      ventilation_reset();
+    testMillis = runtime * 1000;
+    ventilation_add(co2);
+  }
+  fclose(f);
+}
+
+
+int main(int argc, char *argv[]) {
+  const ventilation_t *v;
+  uint8_t logged;
+  int16_t ach;
+
+  if (argc > 1) {
+    replayLog(argv[1]);
+    return 0;
+  }
+
+  // no ventilation, only noise
+  room(0, 3600, 600, 0.1, 300, 10, 15);
+  CHECK_EQ(events, 0);
+  CHECK_EQ(ventilation_ach(), -1);
+
+  // window tilted shortly, drop too small to be logged
+  room(10000, 1800, 100, 4.0, 300, 10, 5);
+  CHECK_EQ(events, 0);
+  CHECK(ventilation_last() == NULL);
+
+  // 10 min. with windows wide open while people stay in the room
+  room(20000, 1800, 600, 4.0, 600, 10, 5);
+  CHECK_EQ(events, 1);
+  CHECK(ventilation_ach() >= 35 && ventilation_ach() <= 45);
+  v = ventilation_last();
+  CHECK(v != NULL);
+  if (v) {
+    CHECK(v->duration >= 500 && v->duration <= 700);
+    CHECK(v->startPPM - v->endPPM >= 300);
+  }
+
+  // same with realistic sensor noise
+  ach = medianACH(100000, 600, 4.0, 600, 10, 15, &logged);
+  CHECK_EQ(logged, ROOMS);
+  CHECK(ach >= 30 && ach <= 50);
+
+  // weaker ventilation at low power interval
+  ach = medianACH(200000, 1200, 1.5, 600, 60, 10, &logged);
+  CHECK_EQ(logged, ROOMS);
+  CHECK(ach >= 11 && ach <= 19);
+
+  // empty room, slow decline after closing the windows must not
+  // extend the event (was logged as ~45min with 6ach before)
+  ach = medianACH(300000, 1200, 1.5, 0, 10, 5, &logged);
+  CHECK(logged >= ROOMS / 2);
+  CHECK(ach >= 11 && ach <= 19);
+  v = ventilation_last();
+  CHECK(v != NULL);
+  if (v)
+    CHECK(v->duration >= 1000 && v->duration <= 1500);
+
+  // calibration drops current event, last one is kept
+  events = 0;
+  room(400000, 1800, 600, 4.0, 600, 10, 5);
+  CHECK_EQ(events, 1);
+  ach = ventilation_ach();
+  for (uint16_t i = 0; i < 30; i++) {
+    testMillis = (410000 + i * 10) * 1000;
+    ventilation_add(1600 - i * 10);
+  }
+  ventilation_reset();
+  for (uint16_t i = 0; i < 30; i++) {
+    testMillis = (410300 + i * 10) * 1000;
+    ventilation_add(1300 + i * 10);
+  }
+  CHECK_EQ(events, 1);
+  CHECK_EQ(ventilation_ach(), ach);
+
+  return testResult("ventilation");
+}
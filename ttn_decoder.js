@@ -62,10 +62,26 @@ function Decoder(bytes, port) {
 					decoded.co2 = (bytes[i+1] << 8) + bytes[i+2];
 					i= i+2;
 					break;
+				case 0x14:
+					decoded.trend = (bytes[i+1] & 0x80 ? 0xffff << 16 : 0) + (bytes[i+1] << 8) + bytes[i+2];
+					i= i+2;
+					break;
+				case 0x15:
+					decoded.forecast = bytes[i+1];
+					i= i+1;
+					break;
 				case 0x20:
 					decoded.vbat = (bytes[i+1]+256)/100;
 					i= i+1;
 					break;
+				case 0x21:
+					decoded.soc = bytes[i+1];
+					i= i+1;
+					break;
+				case 0x22:
+					decoded.runtime = (bytes[i+1] << 8) + bytes[i+2];
+					i= i+2;
+					break;
 			}
 		}
 	}